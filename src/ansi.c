@@ -0,0 +1,249 @@
+#include <curses.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ansi.h"
+#include "terminal.h"
+#include "window.h"
+
+#define ANSI_BLANK ((chtype)' ')
+
+// What the terminal is set to while the frame is being built, -1 when it
+// isn't known.
+typedef struct AnsiState {
+    char *out;
+    int x;
+    int y;
+    int pair;
+    int shifted;
+} AnsiState;
+
+static void ansi_append(AnsiState *const state, const char *const s, const size_t len) {
+    memcpy(state->out, s, len);
+    state->out += len;
+}
+
+static int ansi_count_digits(int n) {
+    int digits = 1;
+    while (n >= 10) {
+        n /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+/* The colors of the pairs are the ones set up in init(), pair 0 is white
+ * on black like curses draws it without default colors. The alternate charset
+ * is the DEC line drawing set put in G1 by ansi_create, a single SO/SI
+ * switches to it and back. */
+Ansi *ansi_create(void) {
+    Ansi *ret = malloc(sizeof(Ansi));
+    if (ret == NULL) {
+        fprintf(stderr, "Couldn't alloc ansi in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    ret->width = COLS;
+    ret->height = LINES;
+    ret->out_size = (size_t)ret->width * ret->height * ANSI_MAX_CELL_BYTES +
+        ANSI_EXTRA_BYTES;
+    ret->back = malloc(sizeof(chtype) * ret->width * ret->height);
+    ret->front = malloc(sizeof(chtype) * ret->width * ret->height);
+    ret->out = malloc(ret->out_size);
+    if (ret->back == NULL || ret->front == NULL || ret->out == NULL) {
+        fprintf(stderr, "Couldn't alloc ansi cells in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < ret->width * ret->height; i++) {
+        ret->back[i] = ANSI_BLANK;
+        ret->front[i] = ANSI_BLANK;
+    }
+    ret->cleared = false;
+
+    for (int pair = 0; pair < ANSI_MAX_PAIRS; pair++) {
+        short fg, bg;
+        if (pair >= COLOR_PAIRS || pair_content(pair, &fg, &bg) == ERR)
+            fg = bg = -1;
+        // -1 is the terminal's default color
+        snprintf(ret->sgr[pair], sizeof(ret->sgr[pair]), "\033[%d;%dm",
+                fg >= 0 && fg < 8 ? 30 + fg : 39,
+                bg >= 0 && bg < 8 ? 40 + bg : 49);
+    }
+    return ret;
+}
+
+/* Leaves the terminal with the default colors and charset, curses redraws
+ * everything after the game. */
+void ansi_destroy(Ansi *const ansi) {
+    static const char reset[] = "\033[m\017";
+    if (write(STDOUT_FILENO, reset, strlen(reset)) < 0) {
+        // nothing to do about it, curses clears the screen next anyway
+    }
+    free(ansi->back);
+    free(ansi->front);
+    free(ansi->out);
+    free(ansi);
+}
+
+/* Copies the cells of the window to where it is on the screen. */
+void ansi_stage(Ansi *const ansi, const Window *const window) {
+    for (int y = 0; y < window->height; y++) {
+        const int screen_y = window->y + y;
+        if (screen_y < 0 || screen_y >= ansi->height)
+            continue;
+        for (int x = 0; x < window->width; x++) {
+            const int screen_x = window->x + x;
+            if (screen_x < 0 || screen_x >= ansi->width)
+                continue;
+            ansi->back[screen_x + screen_y*ansi->width] = window->back[x + y*window->width];
+        }
+    }
+}
+
+static int ansi_get_pair(const chtype ch) {
+    const int pair = PAIR_NUMBER(ch);
+    return pair < ANSI_MAX_PAIRS ? pair : 0;
+}
+
+/* The cells between the cursor and x on its row can be written again
+ * instead of moving over them when they look the same as what the
+ * terminal already shows and don't need any color or charset switch. */
+static bool ansi_can_rewrite(
+        const Ansi *const ansi,
+        const AnsiState *const state,
+        const int x) {
+    const chtype *row = ansi->front + state->y*ansi->width;
+    for (int i = state->x; i < x; i++) {
+        if (ansi_get_pair(row[i]) != state->pair ||
+                !!(row[i] & A_ALTCHARSET) != state->shifted)
+            return false;
+    }
+    return true;
+}
+
+/* Moves the cursor to x, y with whichever of the sequences is the
+ * shortest. */
+static void ansi_move(const Ansi *const ansi, AnsiState *const state, const int x, const int y) {
+    if (state->x == x && state->y == y)
+        return;
+
+    char best[32];
+    int len = snprintf(best, sizeof(best), "\033[%d;%dH", y + 1, x + 1);
+    if (state->y == y && state->x >= 0) {
+        const int n = x > state->x ? x - state->x : state->x - x;
+        // cursor forward or back, the count is left out when it's 1
+        const int step_len = n == 1 ? 3 : 3 + ansi_count_digits(n);
+        if (x > state->x && n < step_len && ansi_can_rewrite(ansi, state, x)) {
+            const chtype *row = ansi->front + y*ansi->width;
+            for (int i = state->x; i < x; i++)
+                *state->out++ = row[i] & A_CHARTEXT;
+            state->x = x;
+            return;
+        }
+        if (x == 0) {
+            len = snprintf(best, sizeof(best), "\r");
+        } else if (step_len < len) {
+            if (n == 1)
+                len = snprintf(best, sizeof(best), "\033[%c", x > state->x ? 'C' : 'D');
+            else
+                len = snprintf(best, sizeof(best), "\033[%d%c", n, x > state->x ? 'C' : 'D');
+        }
+    } else if (x == 0 && state->y >= 0 && y == state->y + 1) {
+        len = snprintf(best, sizeof(best), "\r\n");
+    }
+    ansi_append(state, best, len);
+    state->x = x;
+    state->y = y;
+}
+
+static void ansi_put(Ansi *const ansi, AnsiState *const state, const int x, const int y) {
+    const chtype ch = ansi->back[x + y*ansi->width];
+    ansi_move(ansi, state, x, y);
+
+    const int pair = ansi_get_pair(ch);
+    if (pair != state->pair) {
+        ansi_append(state, ansi->sgr[pair], strlen(ansi->sgr[pair]));
+        state->pair = pair;
+    }
+    const int shifted = !!(ch & A_ALTCHARSET);
+    if (shifted != state->shifted) {
+        *state->out++ = shifted ? '\016' : '\017';
+        state->shifted = shifted;
+    }
+    *state->out++ = ch & A_CHARTEXT;
+
+    // the cursor stays on the last column until the next character, where
+    // exactly depends on the terminal
+    state->x = x + 1 < ansi->width ? x + 1 : -1;
+}
+
+static void ansi_write(const char *buf, size_t len) {
+    while (len > 0) {
+        const ssize_t ret = write(STDOUT_FILENO, buf, len);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        buf += ret;
+        len -= ret;
+    }
+}
+
+/* Writes the cells that changed since the last frame. The grid is kept as
+ * it is, a window that isn't staged for the next frame stays on the screen
+ * like it does with curses. With sync the frame is in a synchronized
+ * update. Returns the bytes and writes it took. */
+TerminalIo ansi_present(Ansi *const ansi, const bool sync) {
+    const TerminalIo before = terminal_get_io();
+    // room for the synchronized update begin is left in front of the frame
+    char *const start = ansi->out + strlen(TERMINAL_SYNC_BEGIN);
+    AnsiState state = {
+        .out = start,
+        .x = -1,
+        .y = -1,
+        .pair = -1,
+        .shifted = -1
+    };
+
+    if (!ansi->cleared) {
+        // G1 is the line drawing set, then the screen is cleared with the
+        // colors of pair 0 which is what the blank cells are
+        static const char charset[] = "\033)0";
+        static const char clear[] = "\033[2J";
+        ansi_append(&state, charset, strlen(charset));
+        ansi_append(&state, ansi->sgr[0], strlen(ansi->sgr[0]));
+        ansi_append(&state, clear, strlen(clear));
+        state.pair = 0;
+        ansi->cleared = true;
+    }
+    for (int y = 0; y < ansi->height; y++) {
+        const chtype *back = ansi->back + y*ansi->width;
+        chtype *front = ansi->front + y*ansi->width;
+        if (memcmp(back, front, sizeof(chtype) * ansi->width) == 0)
+            continue;
+        for (int x = 0; x < ansi->width; x++) {
+            if (back[x] == front[x])
+                continue;
+            ansi_put(ansi, &state, x, y);
+            front[x] = back[x];
+        }
+    }
+
+    if (state.out != start) {
+        const char *frame = start;
+        if (sync) {
+            frame = ansi->out;
+            memcpy(ansi->out, TERMINAL_SYNC_BEGIN, strlen(TERMINAL_SYNC_BEGIN));
+            ansi_append(&state, TERMINAL_SYNC_END, strlen(TERMINAL_SYNC_END));
+        }
+        ansi_write(frame, state.out - frame);
+    }
+    const TerminalIo after = terminal_get_io();
+    return (TerminalIo){
+        .bytes = after.bytes - before.bytes,
+        .writes = after.writes - before.writes
+    };
+}
@@ -0,0 +1,47 @@
+#ifndef ANSI_H
+#define ANSI_H
+
+#include <curses.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "terminal.h"
+#include "window.h"
+
+/* Render backend that doesn't go through curses' output. The windows are
+ * copied into a cell grid as big as the terminal and ansi_present compares
+ * it with what the terminal shows, builds the cursor moves, colors and
+ * characters for the cells that differ and writes the whole frame with one
+ * write(). Only the games use it, the menus are still drawn by curses. */
+
+// pairs whose colors are looked up once at the start
+#define ANSI_MAX_PAIRS 256
+// the longest a single cell can take: a cursor move, colors, a charset
+// shift and the character
+#define ANSI_MAX_CELL_BYTES 32
+// room for clearing the screen and the synchronized update markers
+#define ANSI_EXTRA_BYTES 64
+
+typedef struct Ansi {
+    int width;
+    int height;
+    // the same cells as in Window, back is the frame being staged and
+    // front what the terminal shows, back keeps the windows that weren't
+    // staged this frame
+    chtype *back;
+    chtype *front;
+    // the frame is built here, big enough for every cell changing
+    char *out;
+    size_t out_size;
+    // the first frame clears the screen, curses' content is unknown
+    bool cleared;
+    // "\033[3x;4ym" for every pair
+    char sgr[ANSI_MAX_PAIRS][32];
+} Ansi;
+
+Ansi *ansi_create(void);
+void ansi_destroy(Ansi *const ansi);
+void ansi_stage(Ansi *const ansi, const Window *const window);
+TerminalIo ansi_present(Ansi *const ansi, const bool sync);
+
+#endif
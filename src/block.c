@@ -4,8 +4,93 @@
 #include <string.h>
 
 #include "block.h"
-#include "board.h"
-#include "util.h"
+
+static PieceMask piece_masks[BLOCK_MAX][ROTATION_MAX];
+static Wallkick wallkicks[BLOCK_MAX][ROTATION_MAX][ROTATION_MAX];
+
+typedef enum WallkickClass {
+    WALLKICK_JLSTZ,
+    WALLKICK_I,
+    WALLKICK_O,
+    WALLKICK_CLASS_MAX
+} WallkickClass;
+
+/* SRS tests indexed by piece class, rotation from and rotation to.
+ * Table copied from:
+ * https://tetris.fandom.com/wiki/SRS#SRS_vs_.5B.5BSRS.5D.5D
+ * with the y axis flipped because our y grows downwards. Counter clockwise
+ * tests are the clockwise ones of the opposite rotation negated.
+ * There are no 180 kicks in the guideline so those are the first five
+ * tests from tetr.io's SRS+. Unused entries have no tests at all. */
+static const Wallkick srs_wallkicks
+        [WALLKICK_CLASS_MAX][ROTATION_MAX][ROTATION_MAX] = {
+    [WALLKICK_JLSTZ] = {
+        [UP] = {
+            [RIGHT] = { 5, { {0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2} } },
+            [DOWN] = { 5, { {0, 0}, {0, -1}, {1, -1}, {-1, -1}, {1, 0} } },
+            [LEFT] = { 5, { {0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2} } },
+        },
+        [RIGHT] = {
+            [UP] = { 5, { {0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2} } },
+            [DOWN] = { 5, { {0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2} } },
+            [LEFT] = { 5, { {0, 0}, {1, 0}, {1, -2}, {1, -1}, {0, -2} } },
+        },
+        [DOWN] = {
+            [UP] = { 5, { {0, 0}, {0, 1}, {-1, 1}, {1, 1}, {-1, 0} } },
+            [RIGHT] = { 5, { {0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2} } },
+            [LEFT] = { 5, { {0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2} } },
+        },
+        [LEFT] = {
+            [UP] = { 5, { {0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2} } },
+            [RIGHT] = { 5, { {0, 0}, {-1, 0}, {-1, -2}, {-1, -1}, {0, -2} } },
+            [DOWN] = { 5, { {0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2} } },
+        },
+    },
+    [WALLKICK_I] = {
+        [UP] = {
+            [RIGHT] = { 5, { {0, 0}, {-2, 0}, {1, 0}, {-2, 1}, {1, -2} } },
+            [DOWN] = { 1, { {0, 0} } },
+            [LEFT] = { 5, { {0, 0}, {-1, 0}, {2, 0}, {-1, -2}, {2, 1} } },
+        },
+        [RIGHT] = {
+            [UP] = { 5, { {0, 0}, {2, 0}, {-1, 0}, {2, -1}, {-1, 2} } },
+            [DOWN] = { 5, { {0, 0}, {-1, 0}, {2, 0}, {-1, -2}, {2, 1} } },
+            [LEFT] = { 1, { {0, 0} } },
+        },
+        [DOWN] = {
+            [UP] = { 1, { {0, 0} } },
+            [RIGHT] = { 5, { {0, 0}, {1, 0}, {-2, 0}, {1, 2}, {-2, -1} } },
+            [LEFT] = { 5, { {0, 0}, {2, 0}, {-1, 0}, {2, -1}, {-1, 2} } },
+        },
+        [LEFT] = {
+            [UP] = { 5, { {0, 0}, {1, 0}, {-2, 0}, {1, 2}, {-2, -1} } },
+            [RIGHT] = { 1, { {0, 0} } },
+            [DOWN] = { 5, { {0, 0}, {-2, 0}, {1, 0}, {-2, 1}, {1, -2} } },
+        },
+    },
+    [WALLKICK_O] = {
+        [UP] = {
+            [RIGHT] = { 1, { {0, 0} } },
+            [DOWN] = { 1, { {0, 0} } },
+            [LEFT] = { 1, { {0, 0} } },
+        },
+        [RIGHT] = {
+            [UP] = { 1, { {0, 0} } },
+            [DOWN] = { 1, { {0, 0} } },
+            [LEFT] = { 1, { {0, 0} } },
+        },
+        [DOWN] = {
+            [UP] = { 1, { {0, 0} } },
+            [RIGHT] = { 1, { {0, 0} } },
+            [LEFT] = { 1, { {0, 0} } },
+        },
+        [LEFT] = {
+            [UP] = { 1, { {0, 0} } },
+            [RIGHT] = { 1, { {0, 0} } },
+            [DOWN] = { 1, { {0, 0} } },
+        },
+    },
+};
 
 static Move block_offset[4] = {
     { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 }
@@ -77,136 +162,55 @@ Move block_get_rotation_offset(const BlockType type, const Rotation rot) {
     }
 }
 
-Move block_get_wallkick(const BlockType type, const Rotation rot, const int test) {
-    // table copied from:
-    // https://tetris.fandom.com/wiki/SRS#SRS_vs_.5B.5BSRS.5D.5D
+static WallkickClass block_get_wallkick_class(const BlockType type) {
     switch (type) {
     case BLOCK_I:
-        switch (rot) {
-        // 0>>1
-        case RIGHT:
-            switch (test) {
-            case 0:
-                return (Move){ -2, 0 };
-            case 1:
-                return (Move){ 1, 0 };
-            case 2:
-                return (Move){ -2, 1 };
-            case 3:
-                return (Move){ 1, -2 };
-            default:
-                goto err;
-            }
-        // 1>>2
-        case DOWN:
-            switch (test) {
-            case 0:
-                return (Move){ -1, 0 };
-            case 1:
-                return (Move){ 2, 0 };
-            case 2:
-                return (Move){ -1, -2 };
-            case 3:
-                return (Move){ 2, 1 };
-            default:
-                goto err;
-            }
-        // 2>>3
-        case LEFT:
-            switch (test) {
-            case 0:
-                return (Move){ 2, 0 };
-            case 1:
-                return (Move){ -1, 0 };
-            case 2:
-                return (Move){ 2, -1 };
-            case 3:
-                return (Move){ -1, 2 };
-            default:
-                goto err;
-            }
-        // 3>>0
-        case UP:
-            switch (test) {
-            case 0:
-                return (Move){ 1, 0 };
-            case 1:
-                return (Move){ -2, 0 };
-            case 2:
-                return (Move){ 1, 2 };
-            case 3:
-                return (Move){ -2, -1 };
-            default:
-                goto err;
-            }
-        default:
-            goto err;
-        }
+        return WALLKICK_I;
+    case BLOCK_O:
+        return WALLKICK_O;
     default:
-        switch (rot) {
-        // 0>>1
-        case RIGHT:
-            switch (test) {
-            case 0:
-                return (Move){ -1, 0 };
-            case 1:
-                return (Move){ -1, -1 };
-            case 2:
-                return (Move){ 0, 2 };
-            case 3:
-                return (Move){ -1, 2 };
-            default:
-                goto err;
-            }
-        // 1>>2
-        case DOWN:
-            switch (test) {
-            case 0:
-                return (Move){ 1, 0 };
-            case 1:
-                return (Move){ 1, 1 };
-            case 2:
-                return (Move){ 0, -2 };
-            case 3:
-                return (Move){ 1, -2 };
-            default:
-                goto err;
-            }
-        // 2>>3
-        case LEFT:
-            switch (test) {
-            case 0:
-                return (Move){ 1, 0 };
-            case 1:
-                return (Move){ 1, -1 };
-            case 2:
-                return (Move){ 0, 2 };
-            case 3:
-                return (Move){ 1, 2 };
-            default:
-                goto err;
-            }
-        // 3>>0
-        case UP:
-            switch (test) {
-            case 0:
-                return (Move){ -1, 0 };
-            case 1:
-                return (Move){ -1, 1 };
-            case 2:
-                return (Move){ 0, -2 };
-            case 3:
-                return (Move){ -1, -2 };
-            default:
-                goto err;
+        return WALLKICK_JLSTZ;
+    }
+}
+
+/* Folds the rotation offsets into the SRS tests so rotating is just a scan
+ * over at most WALLKICK_TESTS moves. Going clockwise from -> to adds the
+ * offsets of every rotation passed on the way, the offsets of a full turn
+ * add up to zero so that also works for counter clockwise and 180. */
+__attribute__((constructor))
+static void block_generate_wallkicks(void) {
+    for (BlockType type = BLOCK_EMPTY; type < BLOCK_MAX; type++) {
+        const WallkickClass class = block_get_wallkick_class(type);
+        for (Rotation from = UP; from < ROTATION_MAX; from++) {
+            for (Rotation to = UP; to < ROTATION_MAX; to++) {
+                Move offset = { 0, 0 };
+                for (Rotation rot = from; rot != to;) {
+                    rot = (rot+1) % ROTATION_MAX;
+                    Move move = block_get_rotation_offset(type, rot);
+                    offset.x += move.x;
+                    offset.y += move.y;
+                }
+
+                Wallkick kick = srs_wallkicks[class][from][to];
+                for (int i = 0; i < kick.tests; i++) {
+                    kick.moves[i].x += offset.x;
+                    kick.moves[i].y += offset.y;
+                }
+                wallkicks[type][from][to] = kick;
             }
-        default:
-            goto err;
         }
     }
-err:
-    fprintf(stderr, "AAAAAAAAAAAAAAAAAAAAAA");
-    exit(EXIT_FAILURE);
+}
+
+const Wallkick *block_get_wallkick(
+        const BlockType type,
+        const Rotation from,
+        const Rotation to) {
+    assert(type >= BLOCK_EMPTY && type < BLOCK_MAX);
+    assert(from >= UP && from < ROTATION_MAX);
+    assert(to >= UP && to < ROTATION_MAX);
+
+    return &wallkicks[type][from][to];
 }
 
 bool (*block_get_arr(const BlockType type))[BLOCK_ARR_DIM] {
@@ -256,14 +260,13 @@ BlockColor block_get_color(const BlockType type) {
     }
 }
 
-bool block_get_tile(const Block *const block, const int x, const int y) {
-    assert(x < BLOCK_ARR_DIM);
-    assert(x >= 0);
-    assert(y < BLOCK_ARR_DIM);
-    assert(y >= 0);
-
-    bool (*arr)[BLOCK_ARR_DIM] = block_get_arr(block->type);
-    switch (block->rot) {
+static bool block_get_arr_tile(
+        const BlockType type,
+        const Rotation rot,
+        const int x,
+        const int y) {
+    bool (*arr)[BLOCK_ARR_DIM] = block_get_arr(type);
+    switch (rot) {
     case UP:
         return arr[y][x];
     case RIGHT:
@@ -278,7 +281,68 @@ bool block_get_tile(const Block *const block, const int x, const int y) {
     }
 }
 
-SevenBag *seven_bag_create(void) {
+/* Builds the piece_masks table before main so block_get_mask never has to
+ * check whether it was generated, even when called from many threads. */
+__attribute__((constructor))
+static void block_generate_masks(void) {
+    for (BlockType type = BLOCK_EMPTY; type < BLOCK_MAX; type++) {
+        for (Rotation rot = UP; rot < ROTATION_MAX; rot++) {
+            // an empty block gets min > max so loops over it do nothing
+            PieceMask mask = {
+                .min_x = BLOCK_ARR_DIM,
+                .max_x = -1,
+                .min_y = BLOCK_ARR_DIM,
+                .max_y = -1,
+                .bottom = { -1, -1, -1, -1 }
+            };
+            for (int y = 0; y < BLOCK_ARR_DIM; y++) {
+                for (int x = 0; x < BLOCK_ARR_DIM; x++) {
+                    if (!block_get_arr_tile(type, rot, x, y))
+                        continue;
+                    mask.rows[y] |= 1u << x;
+                    mask.bottom[x] = y;
+                    if (x < mask.min_x)
+                        mask.min_x = x;
+                    if (x > mask.max_x)
+                        mask.max_x = x;
+                    if (y < mask.min_y)
+                        mask.min_y = y;
+                    if (y > mask.max_y)
+                        mask.max_y = y;
+                }
+            }
+            if (type == BLOCK_EMPTY)
+                mask.min_x = mask.min_y = 0;
+            piece_masks[type][rot] = mask;
+        }
+    }
+}
+
+const PieceMask *block_get_mask(const BlockType type, const Rotation rot) {
+    assert(type >= BLOCK_EMPTY && type < BLOCK_MAX);
+    assert(rot >= UP && rot < ROTATION_MAX);
+
+    return &piece_masks[type][rot];
+}
+
+/* Returns the row y of the mask moved to the board column x. x can be
+ * negative as long as no set tile ends up left of the column 0. */
+uint16_t piece_mask_row_at(const PieceMask *const mask, const int y, const int x) {
+    if (x >= 0)
+        return mask->rows[y] << x;
+    return mask->rows[y] >> -x;
+}
+
+bool block_get_tile(const Block *const block, const int x, const int y) {
+    assert(x < BLOCK_ARR_DIM);
+    assert(x >= 0);
+    assert(y < BLOCK_ARR_DIM);
+    assert(y >= 0);
+
+    return block_get_mask(block->type, block->rot)->rows[y] >> x & 1;
+}
+
+SevenBag *seven_bag_create(const uint64_t seed) {
     SevenBag *ret = malloc(sizeof(SevenBag));
     if (ret == NULL) {
         fprintf(
@@ -287,23 +351,55 @@ SevenBag *seven_bag_create(void) {
                 __func__);
         exit(EXIT_FAILURE);
     }
-    seven_bag_fill(ret);
+    seven_bag_init(ret, seed);
     return ret;
 }
 
+void seven_bag_init(SevenBag *const bag, const uint64_t seed) {
+    // seeding as in pcg32_srandom_r from the PCG basic C implementation:
+    // https://www.pcg-random.org/download.html
+    bag->seed = seed;
+    bag->rng_state = 0;
+    bag->rng_inc = (0xda3e39cb94b95bdbull << 1) | 1;
+    seven_bag_random(bag);
+    bag->rng_state += seed;
+    seven_bag_random(bag);
+
+    seven_bag_fill(bag);
+}
+
 void seven_bag_destroy(SevenBag *const bag) {
     free(bag);
 }
 
+/* PCG32, returns the next 32 random bits of the bag's generator. */
+uint32_t seven_bag_random(SevenBag *const bag) {
+    const uint64_t old = bag->rng_state;
+    bag->rng_state = old * 6364136223846793005ull + bag->rng_inc;
+    const uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+    const uint32_t rot = old >> 59;
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
 void seven_bag_fill(SevenBag *const bag) {
-    *bag = (SevenBag){ 7, { 1, 2, 3, 4, 5, 6, 7 } };
+    bag->left = 7;
+    for (size_t i = 0; i < 7; i++)
+        bag->types[i] = BLOCK_I + i;
     seven_bag_shuffle(bag);
 }
 
 void seven_bag_shuffle(SevenBag *const bag) {
     // Fisher Yates shuffle
     for (size_t i = 7-1; i > 0; i--) {
-        const size_t j = rand() % (i + 1);
+        // Lemire's multiply-shift maps the random bits to [0; i], the
+        // rare products in the low part below threshold are drawn again so
+        // every j is equally likely
+        const uint32_t range = i + 1;
+        const uint32_t threshold = -range % range;
+        uint64_t m = (uint64_t)seven_bag_random(bag) * range;
+        while ((uint32_t)m < threshold)
+            m = (uint64_t)seven_bag_random(bag) * range;
+        const size_t j = m >> 32;
         BlockType tmp = bag->types[j];
         bag->types[j] = bag->types[i];
         bag->types[i] = tmp;
@@ -317,13 +413,9 @@ BlockType seven_bag_get(SevenBag *const bag) {
 }
 
 int block_get_cell_amount(const BlockType type) {
-    bool (*arr)[BLOCK_ARR_DIM] = block_get_arr(type);
+    const PieceMask *mask = block_get_mask(type, UP);
     int cells = 0;
-    for (int i = 0; i < BLOCK_ARR_DIM; i++) {
-        for (int j = 0; j < BLOCK_ARR_DIM; j++) {
-            if (arr[i][j])
-                cells++;
-        }
-    }
+    for (int y = 0; y < BLOCK_ARR_DIM; y++)
+        cells += __builtin_popcount(mask->rows[y]);
     return cells;
 }
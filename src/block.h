@@ -3,8 +3,10 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #define BLOCK_ARR_DIM 4
+#define WALLKICK_TESTS 5
 
 typedef enum BlockType {
     BLOCK_EMPTY,
@@ -46,22 +48,56 @@ typedef struct Block {
     BlockType type;
 } Block;
 
+/* Precomputed shape of a block in one rotation. rows[y] has the bit x set
+ * when the tile x, y of the rotated 4x4 array is set, so it can be shifted
+ * by the block's x and and-ed or or-ed with the board's row masks.
+ * The min/max fields are the extents of the set tiles and bottom[x] is y of
+ * the lowest tile in the column x or -1 if the column is empty. */
+typedef struct PieceMask {
+    uint16_t rows[BLOCK_ARR_DIM];
+    int bottom[BLOCK_ARR_DIM];
+    int min_x;
+    int max_x;
+    int min_y;
+    int max_y;
+} PieceMask;
+
 typedef struct Move {
     int x;
     int y;
 } Move;
 
+/* Positions to try, in order, when rotating a block. The moves already
+ * include the rotation offset so they're relative to the block's position
+ * before the rotation. */
+typedef struct Wallkick {
+    int tests;
+    Move moves[WALLKICK_TESTS];
+} Wallkick;
+
+/* Every bag has its own PCG32 generator so games don't share any random
+ * state and the same seed always gives the same sequence of blocks. */
 typedef struct SevenBag {
     size_t left;
     BlockType types[7];
+    uint64_t seed;
+    uint64_t rng_state;
+    uint64_t rng_inc;
 } SevenBag;
 
 BlockColor block_get_color(const BlockType type);
 bool (*block_get_arr(const BlockType type))[BLOCK_ARR_DIM];
 bool block_get_tile(const Block *const block, const int x, const int y);
+const PieceMask *block_get_mask(const BlockType type, const Rotation rot);
+uint16_t piece_mask_row_at(const PieceMask *const mask, const int y, const int x);
 Move block_get_rotation_offset(const BlockType type, const Rotation rot);
-Move block_get_wallkick(const BlockType type, const Rotation rot, const int test);
-SevenBag *seven_bag_create(void);
+const Wallkick *block_get_wallkick(
+        const BlockType type,
+        const Rotation from,
+        const Rotation to);
+SevenBag *seven_bag_create(const uint64_t seed);
+void seven_bag_init(SevenBag *const bag, const uint64_t seed);
+uint32_t seven_bag_random(SevenBag *const bag);
 void seven_bag_fill(SevenBag *const bag);
 void seven_bag_shuffle(SevenBag *const bag);
 BlockType seven_bag_get(SevenBag *const bag);
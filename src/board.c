@@ -6,40 +6,67 @@
 
 #include "block.h"
 #include "board.h"
+#include "random.h"
 
-Board *board_create(const int width, const int height) {
-    assert(width >= 1);
-    assert(height >= 1);
-    assert(width*height == (long long)width * (long long)height);
+static uint64_t tile_keys[BOARD_MAX_HEIGHT][BOARD_MAX_WIDTH];
 
-    Board *ret = (Board *)malloc(sizeof(Board));
-    if (ret == NULL) {
-        fprintf(stderr, "Couldn't alloc board in function %s.\n", __func__);
-        exit(EXIT_FAILURE);
+/* The keys only have to be random looking and the same in every run so
+ * hashes can be compared between processes, splitmix64 with a fixed seed
+ * does that. */
+__attribute__((constructor))
+static void board_generate_tile_keys(void) {
+    uint64_t state = 0x7e7215;
+    for (int y = 0; y < BOARD_MAX_HEIGHT; y++) {
+        for (int x = 0; x < BOARD_MAX_WIDTH; x++) {
+            tile_keys[y][x] = splitmix64(&state);
+        }
     }
+}
 
-    ret->width = width;
-    ret->height = height;
+uint64_t board_get_tile_key(const int x, const int y) {
+    assert(x >= 0 && x < BOARD_MAX_WIDTH);
+    assert(y >= 0 && y < BOARD_MAX_HEIGHT);
 
-    size_t blocks_size = width*height * sizeof(BlockType);
-    ret->blocks = (BlockType *)malloc(blocks_size);
-    if (ret->blocks == NULL) {
-        fprintf(stderr,
-                "Couldn't alloc board's blocks in function %s.\n",
-                __func__);
-        exit(EXIT_FAILURE);
-    }
-    memset(ret->blocks, BLOCK_EMPTY, blocks_size);
+    return tile_keys[y][x];
+}
 
-    return ret;
+/* Xor of the keys of the tiles of the row y set in mask. */
+uint64_t board_hash_row(const int y, const uint16_t mask) {
+    uint64_t hash = 0;
+    for (unsigned bits = mask; bits; bits &= bits - 1)
+        hash ^= tile_keys[y][__builtin_ctz(bits)];
+    return hash;
 }
 
-void board_destroy(Board *const board) {
-    free(board->blocks);
-    free(board);
+void board_init(Board *const board, const int width, const int height) {
+    assert(width >= 1);
+    assert(width <= BOARD_MAX_WIDTH);
+    assert(height >= 1);
+    assert(height <= BOARD_MAX_HEIGHT);
+    assert(width*height <= BOARD_MAX_CELLS);
+
+    memset(board, 0, sizeof(*board));
+    board->width = width;
+    board->height = height;
+    board->full_row = (1u << width) - 1;
 }
 
-BlockType *board_get_block(
+/* Sets the height of the column x looking for its first tile from the row
+ * from downwards. */
+static void board_find_column_height(
+        Board *const board,
+        const int x,
+        const int from) {
+    board->heights[x] = 0;
+    for (int y = from; y < board->height; y++) {
+        if (board->rows[y] & (1u << x)) {
+            board->heights[x] = board->height - y;
+            return;
+        }
+    }
+}
+
+BlockType board_get_block(
         const Board *const board,
         const int x,
         const int y) {
@@ -48,60 +75,166 @@ BlockType *board_get_block(
     assert(y < board->height);
     assert(y >= 0);
 
-    return board->blocks+x + y*board->width;
+    return board->blocks[x + y*board->width];
 }
 
-bool board_is_row_full(const Board *const board, const int y) {
-    for (int x = 0; x < board->width; x++) {
-        if (*board_get_block(board, x, y) == BLOCK_EMPTY)
-            return false;
+void board_set_block(
+        Board *const board,
+        const int x,
+        const int y,
+        const BlockType type) {
+    assert(x < board->width);
+    assert(x >= 0);
+    assert(y < board->height);
+    assert(y >= 0);
+
+    board->blocks[x + y*board->width] = type;
+    if (board_is_occupied(board, x, y) != (type != BLOCK_EMPTY))
+        board->hash ^= tile_keys[y][x];
+    if (type == BLOCK_EMPTY) {
+        board->rows[y] &= ~(1u << x);
+        if (board_get_column_top(board, x) == y)
+            board_find_column_height(board, x, y+1);
+    } else {
+        board->rows[y] |= 1u << x;
+        if (board->heights[x] < board->height - y)
+            board->heights[x] = board->height - y;
     }
-    return true;
 }
 
-/* This function is for "shifting" blocks down when the blocks make a full row.
- * Variables 'from' and 'to' define a closed interval [from; to]
- * that will be erased and everything above will be shifted down.
- * Those range variables are defined in the same way y coordinate is
- * so 0 is top, height-1 is down. */
-void board_erase_rows(Board *const board, const int from, const int to) {
-    assert(from < board->height);
-    assert(to < board->height);
-    
-    const int higher = to - from + 1;
-    for (int y = to; y >= higher; y--) {
-        for (int x = 0; x < board->width; x++) {
-            if (y-higher < 0) {
-                *board_get_block(board, x, y) = BLOCK_EMPTY;
-            } else {
-                *board_get_block(board, x, y) =
-                    *board_get_block(board, x, y-higher);
-            }
-        }
+/* Sets every tile of the row y that has its bit set in mask to type. */
+void board_fill_row(
+        Board *const board,
+        const int y,
+        const uint16_t mask,
+        const BlockType type) {
+    assert(y < board->height);
+    assert(y >= 0);
+    assert((mask & ~board->full_row) == 0);
+
+    board->hash ^= board_hash_row(y, mask & ~board->rows[y]);
+    board->rows[y] |= mask;
+    uint8_t *row = board->blocks + y*board->width;
+    for (unsigned bits = mask; bits; bits &= bits - 1) {
+        const int x = __builtin_ctz(bits);
+        row[x] = type;
+        if (board->heights[x] < board->height - y)
+            board->heights[x] = board->height - y;
     }
 }
 
-int board_clear_full_rows(Board *const board) {
+/* Returns y of the highest non empty tile in the column x or height if the
+ * column is empty. */
+int board_get_column_top(const Board *const board, const int x) {
+    assert(x < board->width);
+    assert(x >= 0);
+
+    return board->height - board->heights[x];
+}
+
+bool board_is_occupied(const Board *const board, const int x, const int y) {
+    assert(x < board->width);
+    assert(x >= 0);
+    assert(y < board->height);
+    assert(y >= 0);
+
+    return board->rows[y] & (1u << x);
+}
+
+bool board_is_row_full(const Board *const board, const int y) {
+    return board->rows[y] == board->full_row;
+}
+
+/* Moves the rows [from; to] down by the amount of rows in one go,
+ * the rows it lands on get overwritten. */
+static void board_move_rows(
+        Board *const board,
+        const int from,
+        const int to,
+        const int down) {
+    assert(from >= 0);
+    assert(to+down < board->height);
+
+    const int rows = to - from + 1;
+    memmove(board->rows + from+down,
+            board->rows + from,
+            rows * sizeof(*board->rows));
+    memmove(board->blocks + (from+down)*board->width,
+            board->blocks + from*board->width,
+            rows*board->width * sizeof(*board->blocks));
+}
+
+/* Removes every full row in a single pass from the bottom up. Each run of
+ * rows between the full ones is moved down by the amount of full rows
+ * found below it so every row is copied at most once. Returns the amount
+ * of removed rows and if cleared isn't NULL sets the bit y in it for every
+ * removed row y (y as it was before the clear). */
+int board_clear_full_rows(Board *const board, uint64_t *const cleared) {
+    int stack_top = board->height;
+    for (int x = 0; x < board->width; x++) {
+        if (board->height - board->heights[x] < stack_top)
+            stack_top = board->height - board->heights[x];
+    }
+
+    // Rows below the lowest full one stay where they are. The rest can
+    // move so their part of the hash is taken out here and put back after
+    // the rows settle.
+    int lowest_full = board->height - 1;
+    while (lowest_full >= stack_top && !board_is_row_full(board, lowest_full))
+        lowest_full--;
+    if (lowest_full < stack_top) {
+        if (cleared != NULL)
+            *cleared = 0;
+        return 0;
+    }
+    for (int row = stack_top; row <= lowest_full; row++)
+        board->hash ^= board_hash_row(row, board->rows[row]);
+
+    // A full row has a tile in every column so cleared rows are never above
+    // the top of any column. Columns just sink by the amount of removed rows
+    // unless their top tile itself got removed, those have to be looked up.
+    uint16_t lost_top = 0;
+    for (int x = 0; x < board->width; x++) {
+        const int top = board_get_column_top(board, x);
+        if (top < board->height && board_is_row_full(board, top))
+            lost_top |= 1u << x;
+    }
+
+    uint64_t removed = 0;
     int removed_rows = 0;
-    int from = -1;
-    int to = -1;
-    for (int y = 0; y < board->height; y++) {
+    int y = lowest_full;
+    while (y >= stack_top) {
         if (board_is_row_full(board, y)) {
-            if (from == -1)
-                from = to = y;
-            else
-                to++;
-        } else {
-            if (from != -1) {
-                board_erase_rows(board, from, to);
-                removed_rows += to - from + 1;
-            }
-            from = to = -1;
+            removed |= 1ull << y;
+            removed_rows++;
+            y--;
+            continue;
         }
+        const int bottom = y;
+        while (y-1 >= stack_top && !board_is_row_full(board, y-1))
+            y--;
+        if (removed_rows)
+            board_move_rows(board, y, bottom, removed_rows);
+        y--;
     }
-    if (from != -1){
-        board_erase_rows(board, from, to);
-        removed_rows += to - from + 1;
+    if (cleared != NULL)
+        *cleared = removed;
+    memset(board->rows + stack_top, 0, removed_rows * sizeof(*board->rows));
+    memset(board->blocks + stack_top*board->width,
+            BLOCK_EMPTY,
+            removed_rows*board->width * sizeof(*board->blocks));
+    for (int row = stack_top + removed_rows; row <= lowest_full; row++)
+        board->hash ^= board_hash_row(row, board->rows[row]);
+
+    for (int x = 0; x < board->width; x++) {
+        if (lost_top & (1u << x)) {
+            board_find_column_height(
+                    board,
+                    x,
+                    board_get_column_top(board, x) + removed_rows);
+        } else {
+            board->heights[x] -= removed_rows;
+        }
     }
     return removed_rows;
 }
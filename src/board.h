@@ -2,26 +2,65 @@
 #define BOARD_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "block.h"
 
+/* Every row also has an occupancy mask where bit x is set when the tile at
+ * x is not empty, so a board can't be wider than the mask. */
+#define BOARD_MAX_WIDTH 16
+/* board_clear_full_rows reports removed rows as bits of an uint64_t. */
+#define BOARD_MAX_HEIGHT 64
+/* Colors are stored inline so a board can be copied with memcpy, this
+ * limits width*height. It's enough for 16x40 or the standard 10x40. */
+#define BOARD_MAX_CELLS (BOARD_MAX_WIDTH * 40)
+
 typedef struct Board {
     int width;
     int height;
-    /* Pointer to a memory allocation representing current state
-     * where (blocks+x) + y*width is the currect blocks.
-     * x, y = 0 is top left. x = width-1, y = height-1 is bottom right. */
-    BlockType *blocks;
+    /* Mask of a completely filled row, (1 << width) - 1. */
+    uint16_t full_row;
+    /* Row masks, rows[y] is the bitboard of the row y. It always mirrors
+     * the blocks array below and is what collision and full row checks
+     * look at. */
+    uint16_t rows[BOARD_MAX_HEIGHT];
+    /* Skyline, heights[x] is the amount of rows from the highest non empty
+     * tile of the column x to the bottom of the board, 0 when the column is
+     * empty. Kept up to date by board_set_block, board_fill_row and
+     * board_clear_full_rows. */
+    uint8_t heights[BOARD_MAX_WIDTH];
+    /* Zobrist hash of the occupied tiles, the xor of board_get_tile_key of
+     * every non empty tile. Colors aren't part of it. Kept up to date the
+     * same way as heights so two boards with the same tiles filled always
+     * have the same hash no matter how they got there. */
+    uint64_t hash;
+    /* Colors of the tiles, blocks[x + y*width] is the BlockType at x, y.
+     * x, y = 0 is top left. x = width-1, y = height-1 is bottom right.
+     * Don't write to it directly, use board_set_block so the row masks stay
+     * in sync. */
+    uint8_t blocks[BOARD_MAX_CELLS];
 } Board;
 
-Board *board_create(const int width, const int height);
-void board_destroy(Board *const board);
-BlockType *board_get_block(
+void board_init(Board *const board, const int width, const int height);
+BlockType board_get_block(
         const Board *const board,
         const int x,
         const int y);
+void board_set_block(
+        Board *const board,
+        const int x,
+        const int y,
+        const BlockType type);
+void board_fill_row(
+        Board *const board,
+        const int y,
+        const uint16_t mask,
+        const BlockType type);
+int board_get_column_top(const Board *const board, const int x);
+bool board_is_occupied(const Board *const board, const int x, const int y);
 bool board_is_row_full(const Board *const board, const int y);
-void board_erase_rows(Board *const board, const int from, const int to);
-int board_clear_full_rows(Board *const board);
+uint64_t board_get_tile_key(const int x, const int y);
+uint64_t board_hash_row(const int y, const uint16_t mask);
+int board_clear_full_rows(Board *const board, uint64_t *const cleared);
 
 #endif
@@ -0,0 +1,328 @@
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FEATURES_X86
+#endif
+
+#include "board_features.h"
+
+/* The wall bits next to a row need two more bits than the row itself,
+ * wider boards don't fit in the 16 bit lanes and use the scalar kernel. */
+#define FEATURE_MAX_VECTOR_WIDTH 14
+
+typedef void (*FeatureKernel)(const FeatureBatch *, Features *);
+
+static FeatureKernel kernel = features_compute_scalar;
+static const char *kernel_name = "scalar";
+
+void feature_batch_init(
+        FeatureBatch *const batch,
+        const int width,
+        const int height) {
+    assert(width <= BOARD_MAX_WIDTH && height <= BOARD_MAX_HEIGHT);
+    batch->width = width;
+    batch->height = height;
+    batch->count = 0;
+    batch->top = height;
+    memset(batch->rows, 0, sizeof(batch->rows));
+}
+
+/* Empties the batch for the next boards of the same size. Only the rows
+ * the boards used are cleared. */
+void feature_batch_clear(FeatureBatch *const batch) {
+    for (int y = batch->top; y < batch->height; y++)
+        memset(batch->rows[y], 0, sizeof(batch->rows[y]));
+    batch->count = 0;
+    batch->top = batch->height;
+}
+
+/* Copies the rows of board to the next free lane and returns its index, or
+ * -1 when the batch is full. Rows above the highest tile of the board are
+ * left alone so they have to be empty already, feature_batch_init and
+ * feature_batch_clear make sure of that. */
+int feature_batch_add(FeatureBatch *const batch, const Board *const board) {
+    assert(board->width == batch->width && board->height == batch->height);
+    if (batch->count == FEATURE_LANES)
+        return -1;
+    const int lane = batch->count++;
+
+    int max_height = 0;
+    for (int x = 0; x < board->width; x++) {
+        if (board->heights[x] > max_height)
+            max_height = board->heights[x];
+    }
+    const int top = board->height - max_height;
+    for (int y = top; y < board->height; y++)
+        batch->rows[y][lane] = board->rows[y];
+    if (top < batch->top)
+        batch->top = top;
+    return lane;
+}
+
+/* Works on one board at a time with 32 bit masks so it handles every
+ * width. Also the reference for the vector kernels. */
+void features_compute_scalar(
+        const FeatureBatch *const batch,
+        Features *const features) {
+    const int width = batch->width;
+    const int height = batch->height;
+    const int top = batch->top;
+    const uint32_t full = (1u << width) - 1;
+    const uint32_t walls = 1u | 1u << (width + 1);
+    const uint32_t pairs = full >> 1;
+
+    for (int i = 0; i < FEATURE_LANES; i++) {
+        int sum = 0;
+        int empty_rows = 0;
+        int holes = 0;
+        // every empty row above top has the two wall transitions
+        int row_transitions = 2 * top;
+        int column_transitions = 0;
+        int bumpiness = 0;
+        int wells = 0;
+        uint32_t covered = 0;
+        uint32_t previous = top > 0 || top == height ? 0 : batch->rows[0][i];
+
+        for (int y = top; y < height; y++) {
+            const uint32_t row = batch->rows[y][i];
+            holes += __builtin_popcount(covered & ~row);
+            covered |= row;
+            sum += __builtin_popcount(covered);
+            empty_rows += covered == 0;
+
+            const uint32_t walled = row << 1 | walls;
+            row_transitions += __builtin_popcount(
+                    (walled ^ walled >> 1) & (full << 1 | 1));
+            column_transitions += __builtin_popcount(row ^ previous);
+            previous = row;
+
+            // Two neighbouring columns differ by as many rows as there are
+            // rows where only one of them is covered, a column is in a
+            // well for every row where it's open and both neighbours are
+            // covered.
+            bumpiness += __builtin_popcount((covered ^ covered >> 1) & pairs);
+            const uint32_t walled_covered = covered << 1 | walls;
+            wells += __builtin_popcount(
+                    ~covered & walled_covered & walled_covered >> 2 & full);
+        }
+        column_transitions += __builtin_popcount(~previous & full);
+
+        features->height[i] = sum;
+        features->max_height[i] = height - top - empty_rows;
+        features->holes[i] = holes;
+        features->row_transitions[i] = row_transitions;
+        features->column_transitions[i] = column_transitions;
+        features->bumpiness[i] = bumpiness;
+        features->wells[i] = wells;
+    }
+}
+
+#ifdef FEATURES_X86
+
+/* Popcount of every 16 bit lane, SSE2 has no popcount instruction so it's
+ * done the SWAR way. */
+__attribute__((target("sse2")))
+static inline __m128i features_popcount_sse2(__m128i x) {
+    const __m128i m1 = _mm_set1_epi16(0x5555);
+    const __m128i m2 = _mm_set1_epi16(0x3333);
+    const __m128i m4 = _mm_set1_epi16(0x0f0f);
+    x = _mm_sub_epi16(x, _mm_and_si128(_mm_srli_epi16(x, 1), m1));
+    x = _mm_add_epi16(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi16(x, 2), m2));
+    x = _mm_and_si128(_mm_add_epi16(x, _mm_srli_epi16(x, 4)), m4);
+    return _mm_and_si128(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), _mm_set1_epi16(0x1f));
+}
+
+/* The same as the scalar kernel with 8 boards per instruction, the batch
+ * is done in two halves. The loads are unaligned because a batch inside a
+ * malloced struct isn't always on a 32 byte boundary. */
+__attribute__((target("sse2")))
+static void features_compute_sse2(
+        const FeatureBatch *const batch,
+        Features *const features) {
+    const int width = batch->width;
+    const int height = batch->height;
+    const int top = batch->top;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16((1 << width) - 1);
+    const __m128i walls = _mm_set1_epi16(1 | 1 << (width + 1));
+    const __m128i walled_full = _mm_set1_epi16((1 << (width + 1)) - 1);
+    const __m128i pairs = _mm_set1_epi16(((1 << width) - 1) >> 1);
+
+    for (int half = 0; half < FEATURE_LANES; half += 8) {
+        __m128i sum = zero;
+        __m128i empty_rows = zero;
+        __m128i holes = zero;
+        __m128i row_transitions = _mm_set1_epi16(2 * top);
+        __m128i column_transitions = zero;
+        __m128i bumpiness = zero;
+        __m128i wells = zero;
+        __m128i covered = zero;
+        __m128i previous = top > 0 || top == height
+            ? zero
+            : _mm_loadu_si128((const __m128i *)&batch->rows[0][half]);
+
+        for (int y = top; y < height; y++) {
+            const __m128i row = _mm_loadu_si128((const __m128i *)&batch->rows[y][half]);
+            holes = _mm_add_epi16(holes,
+                    features_popcount_sse2(_mm_andnot_si128(row, covered)));
+            covered = _mm_or_si128(covered, row);
+            sum = _mm_add_epi16(sum, features_popcount_sse2(covered));
+            // the comparison gives -1 for true
+            empty_rows = _mm_sub_epi16(empty_rows, _mm_cmpeq_epi16(covered, zero));
+
+            const __m128i walled = _mm_or_si128(_mm_slli_epi16(row, 1), walls);
+            row_transitions = _mm_add_epi16(row_transitions,
+                    features_popcount_sse2(_mm_and_si128(
+                            _mm_xor_si128(walled, _mm_srli_epi16(walled, 1)),
+                            walled_full)));
+            column_transitions = _mm_add_epi16(column_transitions,
+                    features_popcount_sse2(_mm_xor_si128(row, previous)));
+            previous = row;
+
+            bumpiness = _mm_add_epi16(bumpiness,
+                    features_popcount_sse2(_mm_and_si128(
+                            _mm_xor_si128(covered, _mm_srli_epi16(covered, 1)),
+                            pairs)));
+            const __m128i walled_covered =
+                _mm_or_si128(_mm_slli_epi16(covered, 1), walls);
+            wells = _mm_add_epi16(wells,
+                    features_popcount_sse2(_mm_andnot_si128(covered,
+                            _mm_and_si128(
+                                _mm_and_si128(walled_covered,
+                                    _mm_srli_epi16(walled_covered, 2)),
+                                full))));
+        }
+        column_transitions = _mm_add_epi16(column_transitions,
+                features_popcount_sse2(_mm_andnot_si128(previous, full)));
+
+        const __m128i filled_rows = _mm_set1_epi16(height - top);
+        _mm_storeu_si128((__m128i *)&features->height[half], sum);
+        _mm_storeu_si128((__m128i *)&features->max_height[half],
+                _mm_sub_epi16(filled_rows, empty_rows));
+        _mm_storeu_si128((__m128i *)&features->holes[half], holes);
+        _mm_storeu_si128((__m128i *)&features->row_transitions[half], row_transitions);
+        _mm_storeu_si128((__m128i *)&features->column_transitions[half], column_transitions);
+        _mm_storeu_si128((__m128i *)&features->bumpiness[half], bumpiness);
+        _mm_storeu_si128((__m128i *)&features->wells[half], wells);
+    }
+}
+
+/* AVX2 has byte shuffles, popcount every nibble with a table lookup and
+ * add the four nibbles of a lane together. */
+__attribute__((target("avx2")))
+static inline __m256i features_popcount_avx2(const __m256i x) {
+    const __m256i table = _mm256_setr_epi8(
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i bytes = _mm256_add_epi8(
+            _mm256_shuffle_epi8(table, _mm256_and_si256(x, nibble)),
+            _mm256_shuffle_epi8(table,
+                _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble)));
+    return _mm256_add_epi16(
+            _mm256_and_si256(bytes, _mm256_set1_epi16(0xff)),
+            _mm256_srli_epi16(bytes, 8));
+}
+
+/* The whole batch per instruction. */
+__attribute__((target("avx2")))
+static void features_compute_avx2(
+        const FeatureBatch *const batch,
+        Features *const features) {
+    const int width = batch->width;
+    const int height = batch->height;
+    const int top = batch->top;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16((1 << width) - 1);
+    const __m256i walls = _mm256_set1_epi16(1 | 1 << (width + 1));
+    const __m256i walled_full = _mm256_set1_epi16((1 << (width + 1)) - 1);
+    const __m256i pairs = _mm256_set1_epi16(((1 << width) - 1) >> 1);
+
+    __m256i sum = zero;
+    __m256i empty_rows = zero;
+    __m256i holes = zero;
+    __m256i row_transitions = _mm256_set1_epi16(2 * top);
+    __m256i column_transitions = zero;
+    __m256i bumpiness = zero;
+    __m256i wells = zero;
+    __m256i covered = zero;
+    __m256i previous = top > 0 || top == height
+        ? zero
+        : _mm256_loadu_si256((const __m256i *)batch->rows[0]);
+
+    for (int y = top; y < height; y++) {
+        const __m256i row = _mm256_loadu_si256((const __m256i *)batch->rows[y]);
+        holes = _mm256_add_epi16(holes,
+                features_popcount_avx2(_mm256_andnot_si256(row, covered)));
+        covered = _mm256_or_si256(covered, row);
+        sum = _mm256_add_epi16(sum, features_popcount_avx2(covered));
+        empty_rows = _mm256_sub_epi16(empty_rows, _mm256_cmpeq_epi16(covered, zero));
+
+        const __m256i walled = _mm256_or_si256(_mm256_slli_epi16(row, 1), walls);
+        row_transitions = _mm256_add_epi16(row_transitions,
+                features_popcount_avx2(_mm256_and_si256(
+                        _mm256_xor_si256(walled, _mm256_srli_epi16(walled, 1)),
+                        walled_full)));
+        column_transitions = _mm256_add_epi16(column_transitions,
+                features_popcount_avx2(_mm256_xor_si256(row, previous)));
+        previous = row;
+
+        bumpiness = _mm256_add_epi16(bumpiness,
+                features_popcount_avx2(_mm256_and_si256(
+                        _mm256_xor_si256(covered, _mm256_srli_epi16(covered, 1)),
+                        pairs)));
+        const __m256i walled_covered =
+            _mm256_or_si256(_mm256_slli_epi16(covered, 1), walls);
+        wells = _mm256_add_epi16(wells,
+                features_popcount_avx2(_mm256_andnot_si256(covered,
+                        _mm256_and_si256(
+                            _mm256_and_si256(walled_covered,
+                                _mm256_srli_epi16(walled_covered, 2)),
+                            full))));
+    }
+    column_transitions = _mm256_add_epi16(column_transitions,
+            features_popcount_avx2(_mm256_andnot_si256(previous, full)));
+
+    const __m256i filled_rows = _mm256_set1_epi16(height - top);
+    _mm256_storeu_si256((__m256i *)features->height, sum);
+    _mm256_storeu_si256((__m256i *)features->max_height,
+            _mm256_sub_epi16(filled_rows, empty_rows));
+    _mm256_storeu_si256((__m256i *)features->holes, holes);
+    _mm256_storeu_si256((__m256i *)features->row_transitions, row_transitions);
+    _mm256_storeu_si256((__m256i *)features->column_transitions, column_transitions);
+    _mm256_storeu_si256((__m256i *)features->bumpiness, bumpiness);
+    _mm256_storeu_si256((__m256i *)features->wells, wells);
+}
+
+#endif
+
+/* Picks the widest kernel the cpu running the program has, not the one
+ * the compiler was told about. */
+__attribute__((constructor))
+static void features_pick_kernel(void) {
+#ifdef FEATURES_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = features_compute_avx2;
+        kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernel = features_compute_sse2;
+        kernel_name = "sse2";
+    }
+#endif
+}
+
+/* Features of every board in the batch, lanes without a board get the
+ * features of an empty board. */
+void features_compute(const FeatureBatch *const batch, Features *const features) {
+    if (batch->width > FEATURE_MAX_VECTOR_WIDTH)
+        features_compute_scalar(batch, features);
+    else
+        kernel(batch, features);
+}
+
+const char *features_get_kernel_name(void) {
+    return kernel_name;
+}
@@ -0,0 +1,58 @@
+#ifndef BOARD_FEATURES_H
+#define BOARD_FEATURES_H
+
+#include <stdint.h>
+
+#include "board.h"
+
+/* Board features for evaluating positions, computed straight from the row
+ * masks. Every feature is a popcount of some mask of a row, the only thing
+ * carried from row to row is the union of the rows above (covered), so a
+ * batch of boards is stored one row at a time with a 16 bit lane per board
+ * and a vector instruction works on a whole row of the batch at once. */
+
+#define FEATURE_LANES 16
+
+/* Boards of the same width and height, rows[y][i] is the row y of the
+ * board i. */
+typedef struct FeatureBatch {
+    int width;
+    int height;
+    int count;
+    // the rows above this one are empty on every board in the batch
+    int top;
+    uint16_t rows[BOARD_MAX_HEIGHT][FEATURE_LANES] __attribute__((aligned(32)));
+} FeatureBatch;
+
+/* Features of every board in a batch, feature[i] belongs to the board i.
+ * The walls and the floor count as filled tiles. */
+typedef struct Features {
+    // sum of the column heights
+    uint16_t height[FEATURE_LANES];
+    // rows from the highest non empty tile to the bottom
+    uint16_t max_height[FEATURE_LANES];
+    // empty tiles with a filled one anywhere above them
+    uint16_t holes[FEATURE_LANES];
+    // filled/empty changes going along the rows, walls included
+    uint16_t row_transitions[FEATURE_LANES];
+    // filled/empty changes going down the columns, floor included
+    uint16_t column_transitions[FEATURE_LANES];
+    // sum of the height differences of neighbouring columns
+    uint16_t bumpiness[FEATURE_LANES];
+    // how far every column is below both of its neighbours
+    uint16_t wells[FEATURE_LANES];
+} Features;
+
+void feature_batch_init(
+        FeatureBatch *const batch,
+        const int width,
+        const int height);
+void feature_batch_clear(FeatureBatch *const batch);
+int feature_batch_add(FeatureBatch *const batch, const Board *const board);
+void features_compute(const FeatureBatch *const batch, Features *const features);
+void features_compute_scalar(
+        const FeatureBatch *const batch,
+        Features *const features);
+const char *features_get_kernel_name(void);
+
+#endif
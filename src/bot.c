@@ -0,0 +1,452 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "block.h"
+#include "board.h"
+#include "board_features.h"
+#include "bot.h"
+#include "circular_buffer.h"
+#include "engine.h"
+#include "movegen.h"
+
+static void *bot_worker(void *arg);
+
+Bot *bot_create(const BotConfig *const config) {
+    Bot *ret = calloc(1, sizeof(Bot));
+    if (ret == NULL) {
+        fprintf(stderr, "Couldn't alloc bot in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    ret->config = *config;
+    if (ret->config.threads < 1)
+        ret->config.threads = 1;
+    if (ret->config.threads > BOT_MAX_THREADS)
+        ret->config.threads = BOT_MAX_THREADS;
+    if (ret->config.beam_width < 1)
+        ret->config.beam_width = 1;
+    if (ret->config.beam_width > BOT_MAX_BEAM)
+        ret->config.beam_width = BOT_MAX_BEAM;
+
+    for (int i = 0; i < 2; i++) {
+        ret->beams[i] = malloc(ret->config.beam_width * sizeof(BotNode));
+        if (ret->beams[i] == NULL) {
+            fprintf(stderr, "Couldn't alloc beam in function %s.\n", __func__);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    const int threads = ret->config.threads;
+    for (int i = 0; i < threads; i++) {
+        ret->workers[i] = (BotWorker){
+            .bot = ret,
+            .id = i,
+            .gen = movegen_create()
+        };
+    }
+    if (threads > 1) {
+        pthread_barrier_init(&ret->start_barrier, NULL, threads);
+        pthread_barrier_init(&ret->done_barrier, NULL, threads);
+        // the thread calling bot_search is worker 0
+        for (int i = 1; i < threads; i++) {
+            if (pthread_create(
+                        &ret->workers[i].thread,
+                        NULL,
+                        bot_worker,
+                        &ret->workers[i])) {
+                perror("pthread_create");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    return ret;
+}
+
+void bot_destroy(Bot *const bot) {
+    const int threads = bot->config.threads;
+    if (threads > 1) {
+        bot->phase = BOT_PHASE_QUIT;
+        pthread_barrier_wait(&bot->start_barrier);
+        for (int i = 1; i < threads; i++)
+            pthread_join(bot->workers[i].thread, NULL);
+        pthread_barrier_destroy(&bot->start_barrier);
+        pthread_barrier_destroy(&bot->done_barrier);
+    }
+    for (int i = 0; i < threads; i++) {
+        movegen_destroy(bot->workers[i].gen);
+        free(bot->workers[i].candidates.candidates);
+    }
+    free(bot->selected.candidates);
+    free(bot->beams[0]);
+    free(bot->beams[1]);
+    free(bot);
+}
+
+static void bot_candidates_push(
+        BotCandidates *const candidates,
+        const BotCandidate *const candidate) {
+    if (candidates->used == candidates->size) {
+        candidates->size = candidates->size ? 2 * candidates->size : 256;
+        candidates->candidates = realloc(
+                candidates->candidates,
+                candidates->size * sizeof(BotCandidate));
+        if (candidates->candidates == NULL) {
+            fprintf(
+                    stderr,
+                    "Couldn't alloc bot candidates in function %s.\n",
+                    __func__);
+            exit(EXIT_FAILURE);
+        }
+    }
+    candidates->candidates[candidates->used++] = *candidate;
+}
+
+/* Higher is better. */
+static double bot_score(
+        const Features *const features,
+        const int lane,
+        const BotWeights *const weights) {
+    return weights->height * features->height[lane] +
+        weights->holes * features->holes[lane] +
+        weights->bumpiness * features->bumpiness[lane] +
+        weights->wells * features->wells[lane] +
+        weights->row_transitions * features->row_transitions[lane] +
+        weights->column_transitions * features->column_transitions[lane];
+}
+
+/* Scores a single board, the search scores them a batch at a time. */
+double bot_evaluate(const Board *const board, const BotWeights *const weights) {
+    FeatureBatch batch;
+    Features features;
+    feature_batch_init(&batch, board->width, board->height);
+    const int lane = feature_batch_add(&batch, board);
+    features_compute(&batch, &features);
+    return bot_score(&features, lane, weights);
+}
+
+static double bot_clear_reward(const Bot *const bot, const uint64_t cleared) {
+    if (cleared == 0)
+        return 0;
+    Stats stats = { .level = 1 };
+    stats_update(&stats, cleared);
+    return bot->config.weights.clear * stats.score;
+}
+
+/* The block placed next from node, with or without holding, and what the
+ * hold box and the queue look like after it. Returns false when it can't
+ * be done. */
+static bool bot_get_choice(
+        const Bot *const bot,
+        const BotNode *const node,
+        const bool held,
+        BlockType *const type,
+        BlockType *const hold,
+        int *const next) {
+    const BlockType current = bot->queue[node->next];
+    if (!held) {
+        *type = current;
+        *hold = node->hold;
+        *next = node->next + 1;
+        return true;
+    }
+    if (!node->can_hold)
+        return false;
+    if (node->hold == BLOCK_EMPTY) {
+        if (node->next + 1 >= bot->queue_size)
+            return false;
+        *type = bot->queue[node->next + 1];
+        *next = node->next + 2;
+    } else {
+        // holding the same type as the current block changes nothing
+        if (node->hold == current)
+            return false;
+        *type = node->hold;
+        *next = node->next + 1;
+    }
+    *hold = current;
+    return true;
+}
+
+/* Scores the pending candidates and moves them to the worker's
+ * candidates. */
+static void bot_flush_pending(Bot *const bot, BotWorker *const worker) {
+    if (worker->batch.count == 0)
+        return;
+    Features features;
+    features_compute(&worker->batch, &features);
+    for (int i = 0; i < worker->batch.count; i++) {
+        BotCandidate *candidate = &worker->pending[i];
+        candidate->eval = candidate->reward +
+            bot_score(&features, i, &bot->config.weights);
+        bot_candidates_push(&worker->candidates, candidate);
+    }
+    feature_batch_clear(&worker->batch);
+}
+
+static void bot_expand(Bot *const bot, BotWorker *const worker) {
+    const BotNode *beam = bot->beams[bot->beam];
+    const int used = bot->beam_used[bot->beam];
+    const int threads = bot->config.threads;
+    const int from = used * worker->id / threads;
+    const int to = used * (worker->id + 1) / threads;
+    worker->candidates.used = 0;
+
+    for (int parent = from; parent < to; parent++) {
+        const BotNode *node = &beam[parent];
+        for (int held = 0; held < 2; held++) {
+            BlockType type;
+            BlockType hold;
+            int next;
+            if (!bot_get_choice(bot, node, held, &type, &hold, &next))
+                continue;
+
+            // The current block is already somewhere on the board, every
+            // other one starts at the spawn.
+            size_t placements;
+            if (bot->depth == 0 && !held)
+                placements = movegen_generate_from(worker->gen, &node->board, &bot->start);
+            else
+                placements = movegen_generate(worker->gen, &node->board, type);
+
+            for (size_t i = 0; i < placements; i++) {
+                Block block = worker->gen->placements[i];
+                Board board = node->board;
+                const uint64_t cleared = bake(&block, &board);
+                if (board.rows[FIRST_TRUE_ROW-2] != 0)
+                    continue;
+                const int lane = feature_batch_add(&worker->batch, &board);
+                worker->pending[lane] = (BotCandidate){
+                    .block = worker->gen->placements[i],
+                    .held = held,
+                    .parent = parent,
+                    .reward = node->reward + bot_clear_reward(bot, cleared)
+                };
+                if (worker->batch.count == FEATURE_LANES)
+                    bot_flush_pending(bot, worker);
+            }
+        }
+    }
+    bot_flush_pending(bot, worker);
+}
+
+static void bot_materialize(Bot *const bot, BotWorker *const worker) {
+    const BotNode *beam = bot->beams[bot->beam];
+    BotNode *new_beam = bot->beams[!bot->beam];
+    const int used = bot->beam_used[!bot->beam];
+    const int threads = bot->config.threads;
+    const int from = used * worker->id / threads;
+    const int to = used * (worker->id + 1) / threads;
+
+    for (int i = from; i < to; i++) {
+        const BotCandidate *candidate = &bot->selected.candidates[i];
+        const BotNode *parent = &beam[candidate->parent];
+        BotNode *node = &new_beam[i];
+        BlockType type;
+        *node = *parent;
+        bot_get_choice(bot, parent, candidate->held, &type, &node->hold, &node->next);
+        Block block = candidate->block;
+        bake(&block, &node->board);
+        node->can_hold = true;
+        if (bot->depth == 0) {
+            node->first = candidate->block;
+            node->first_held = candidate->held;
+        }
+        node->reward = candidate->reward;
+        node->eval = candidate->eval;
+    }
+}
+
+static void bot_do_phase(Bot *const bot, BotWorker *const worker) {
+    switch (bot->phase) {
+    case BOT_PHASE_EXPAND:
+        bot_expand(bot, worker);
+        break;
+    case BOT_PHASE_MATERIALIZE:
+        bot_materialize(bot, worker);
+        break;
+    default:
+        break;
+    }
+}
+
+static void *bot_worker(void *arg) {
+    BotWorker *worker = arg;
+    Bot *bot = worker->bot;
+    for (;;) {
+        pthread_barrier_wait(&bot->start_barrier);
+        if (bot->phase == BOT_PHASE_QUIT)
+            break;
+        bot_do_phase(bot, worker);
+        pthread_barrier_wait(&bot->done_barrier);
+    }
+    return NULL;
+}
+
+/* Every worker including the calling thread does its slice of the
+ * phase. */
+static void bot_run_phase(Bot *const bot, const BotPhase phase) {
+    bot->phase = phase;
+    if (bot->config.threads > 1)
+        pthread_barrier_wait(&bot->start_barrier);
+    bot_do_phase(bot, &bot->workers[0]);
+    if (bot->config.threads > 1)
+        pthread_barrier_wait(&bot->done_barrier);
+}
+
+static int bot_compare_candidates(const void *a, const void *b) {
+    const BotCandidate *ca = a;
+    const BotCandidate *cb = b;
+    if (ca->eval != cb->eval)
+        return ca->eval < cb->eval ? 1 : -1;
+    // break ties the same way every time so the bot plays the same game
+    // for the same seed no matter how many threads it has
+    if (ca->parent != cb->parent)
+        return ca->parent - cb->parent;
+    if (ca->held != cb->held)
+        return ca->held - cb->held;
+    if (ca->block.rot != cb->block.rot)
+        return (int)ca->block.rot - (int)cb->block.rot;
+    if (ca->block.y != cb->block.y)
+        return ca->block.y - cb->block.y;
+    return ca->block.x - cb->block.x;
+}
+
+/* Finds where to put the current block. Sets hold when it's better to
+ * hold first, target is then the placement of the block that comes out of
+ * the hold box (or the preview). Returns false when every placement ends
+ * the game. */
+bool bot_search(
+        Bot *const bot,
+        const BoardCtx *const board,
+        Block *const target,
+        bool *const hold) {
+    bot->queue[0] = board->block.type;
+    bot->queue_size = 1;
+    for (size_t i = 0; i < board->buf.used && bot->queue_size < BOT_MAX_DEPTH; i++)
+        bot->queue[bot->queue_size++] = buf_get_head(&board->buf, i);
+    bot->start = board->block;
+    for (int i = 0; i < bot->config.threads; i++) {
+        feature_batch_init(
+                &bot->workers[i].batch,
+                board->board.width,
+                board->board.height);
+    }
+
+    bot->beam = 0;
+    bot->beam_used[0] = 1;
+    bot->beams[0][0] = (BotNode){
+        .board = board->board,
+        .hold = board->hold.curr_type,
+        .can_hold = !board->hold.swapped,
+        .next = 0
+    };
+
+    int depth = bot->config.depth;
+    if (depth > bot->queue_size)
+        depth = bot->queue_size;
+    bool found = false;
+    for (bot->depth = 0; bot->depth < depth; bot->depth++) {
+        bot_run_phase(bot, BOT_PHASE_EXPAND);
+
+        bot->selected.used = 0;
+        for (int t = 0; t < bot->config.threads; t++) {
+            const BotCandidates *candidates = &bot->workers[t].candidates;
+            for (size_t i = 0; i < candidates->used; i++)
+                bot_candidates_push(&bot->selected, &candidates->candidates[i]);
+        }
+        if (bot->selected.used == 0)
+            break;
+        qsort(bot->selected.candidates,
+                bot->selected.used,
+                sizeof(BotCandidate),
+                bot_compare_candidates);
+
+        int width = bot->config.beam_width;
+        if ((size_t)width > bot->selected.used)
+            width = bot->selected.used;
+        bot->beam_used[!bot->beam] = width;
+        bot_run_phase(bot, BOT_PHASE_MATERIALIZE);
+        bot->beam = !bot->beam;
+
+        // the beam is sorted so its first board is the best one so far
+        *target = bot->beams[bot->beam][0].first;
+        *hold = bot->beams[bot->beam][0].first_held;
+        found = true;
+    }
+    return found;
+}
+
+/* Returns the inputs the bot presses this frame. Searches when there's a
+ * new block, and then walks it to its target a few inputs per frame
+ * (config.inputs_per_frame) or all at once finishing with a hard drop. */
+size_t bot_get_inputs(
+        Bot *const bot,
+        const BoardCtx *const board,
+        Input *const inputs,
+        const size_t max) {
+    if (board->block.type == BLOCK_EMPTY || max == 0)
+        return 0;
+
+    // taking a block out of the preview after a hold counts as a new one
+    if (bot->held) {
+        bot->held = false;
+        bot->piece = board->stats.blocks;
+    }
+    if (!bot->has_target ||
+            bot->piece != board->stats.blocks ||
+            bot->target.type != board->block.type) {
+        bool hold = false;
+        bot->piece = board->stats.blocks;
+        bot->has_target = bot_search(bot, board, &bot->target, &hold);
+        if (!bot->has_target) {
+            inputs[0] = INPUT_HARD_DROP;
+            return 1;
+        }
+        if (hold) {
+            bot->held = true;
+            inputs[0] = INPUT_HOLD;
+            return 1;
+        }
+    }
+
+    // The path is looked up again every frame because gravity could have
+    // moved the block since the last one.
+    Input path[BOT_MAX_PATH];
+    const int len = movegen_find_path(
+            bot->workers[0].gen,
+            &board->board,
+            &board->block,
+            &bot->target,
+            path,
+            BOT_MAX_PATH);
+    if (len < 0 || len > BOT_MAX_PATH) {
+        bot->has_target = false;
+        return 0;
+    }
+
+    size_t limit = max;
+    if (bot->config.inputs_per_frame > 0 &&
+            (size_t)bot->config.inputs_per_frame < limit)
+        limit = bot->config.inputs_per_frame;
+    size_t n = 0;
+    for (; n < (size_t)len && n < limit; n++)
+        inputs[n] = path[n];
+    if (n == (size_t)len && n < limit) {
+        inputs[n++] = INPUT_HARD_DROP;
+        bot->has_target = false;
+    }
+    return n;
+}
+
+/* Presses this frame's inputs, like singleplayer_input does for keys. */
+void bot_play(Bot *const bot, BoardCtx *const board, GameCtx *const game) {
+    Input inputs[BOT_MAX_PATH + 1];
+    const size_t n = bot_get_inputs(
+            bot,
+            board,
+            inputs,
+            sizeof(inputs)/sizeof(inputs[0]));
+    for (size_t i = 0; i < n; i++)
+        engine_input(board, game, inputs[i]);
+}
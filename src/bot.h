@@ -0,0 +1,157 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block.h"
+#include "board.h"
+#include "board_features.h"
+#include "engine.h"
+#include "movegen.h"
+
+/* A computer player. Every new block it runs a beam search over the
+ * preview and the hold box: each level places the next block in every
+ * reachable way, scores the boards and keeps the best beam_width of them
+ * for the next level. The block goes where the first placement of the
+ * best board at the end was. It plays through engine_input like a player
+ * would. */
+
+#define BOT_MAX_THREADS 16
+#define BOT_MAX_BEAM 1024
+// the current block and the whole preview
+#define BOT_MAX_DEPTH (STD_BUF_SIZE + 1)
+#define BOT_MAX_PATH 64
+
+/* How much each feature of a board is worth, the features are added up
+ * with these weights and the best sum wins. clear multiplies the points
+ * stats_update gives for the cleared rows. */
+typedef struct BotWeights {
+    double height;
+    double holes;
+    double bumpiness;
+    double wells;
+    double row_transitions;
+    double column_transitions;
+    double clear;
+} BotWeights;
+
+typedef struct BotConfig {
+    int beam_width;
+    int depth;
+    int threads;
+    // inputs sent per frame, 0 sends the whole placement in one frame
+    int inputs_per_frame;
+    BotWeights weights;
+} BotConfig;
+
+static const BotConfig default_bot_config = {
+    .beam_width = 32,
+    .depth = 3,
+    .threads = 1,
+    .inputs_per_frame = 1,
+    .weights = {
+        .height = -0.51,
+        .holes = -3.6,
+        .bumpiness = -0.18,
+        .wells = -0.3,
+        .row_transitions = 0,
+        .column_transitions = 0,
+        .clear = 0.01
+    }
+};
+
+/* A board somewhere in the beam. */
+typedef struct BotNode {
+    Board board;
+    BlockType hold;
+    bool can_hold;
+    // index of the current block in the bot's queue
+    int next;
+    // placement of the current block this board started with
+    Block first;
+    bool first_held;
+    // points for cleared rows on the way here
+    double reward;
+    double eval;
+} BotNode;
+
+typedef struct BotCandidate {
+    Block block;
+    bool held;
+    int parent;
+    double reward;
+    double eval;
+} BotCandidate;
+
+typedef struct BotCandidates {
+    size_t size;
+    size_t used;
+    BotCandidate *candidates;
+} BotCandidates;
+
+typedef enum BotPhase {
+    BOT_PHASE_EXPAND,
+    BOT_PHASE_MATERIALIZE,
+    BOT_PHASE_QUIT
+} BotPhase;
+
+struct Bot;
+
+typedef struct BotWorker {
+    pthread_t thread;
+    struct Bot *bot;
+    int id;
+    MoveGen *gen;
+    BotCandidates candidates;
+    // boards waiting to be scored together, pending[i] is the board in
+    // the lane i of batch
+    FeatureBatch batch;
+    BotCandidate pending[FEATURE_LANES];
+} BotWorker;
+
+typedef struct Bot {
+    BotConfig config;
+    BlockType queue[BOT_MAX_DEPTH];
+    int queue_size;
+    // the current block, placed from where it is and not from the spawn
+    Block start;
+    int depth;
+
+    // the beam being expanded and the one being built
+    BotNode *beams[2];
+    int beam_used[2];
+    int beam;
+    // every worker's candidates, the best ones go to the next beam
+    BotCandidates selected;
+
+    BotPhase phase;
+    pthread_barrier_t start_barrier;
+    pthread_barrier_t done_barrier;
+    BotWorker workers[BOT_MAX_THREADS];
+
+    // what the bot is doing with the current block
+    bool has_target;
+    bool held;
+    int piece;
+    Block target;
+} Bot;
+
+Bot *bot_create(const BotConfig *const config);
+void bot_destroy(Bot *const bot);
+double bot_evaluate(const Board *const board, const BotWeights *const weights);
+bool bot_search(
+        Bot *const bot,
+        const BoardCtx *const board,
+        Block *const target,
+        bool *const hold);
+size_t bot_get_inputs(
+        Bot *const bot,
+        const BoardCtx *const board,
+        Input *const inputs,
+        const size_t max);
+void bot_play(Bot *const bot, BoardCtx *const board, GameCtx *const game);
+
+#endif
@@ -22,28 +22,22 @@ CircularBuffer *buf_create(const size_t size) {
                 __func__);
         exit(EXIT_FAILURE);
     }
-    ret->size = size;
-    ret->used = 0;
-    ret->buffer = malloc(sizeof(*ret->buffer) * size);
-    if (ret == NULL) {
-        fprintf(
-                stderr,
-                "Couldn't alloc circular buffer's buffer in function %s.\n",
-                __func__);
-        exit(EXIT_FAILURE);
-    }
-    ret->head = ret->buffer;
-    ret->tail = ret->buffer;
+    buf_init(ret, size);
     return ret;
 }
 
-void buf_destroy(CircularBuffer *const buf) {
-    free(buf->buffer);
-    free(buf);
+void buf_init(CircularBuffer *const buf, const size_t size) {
+    assert(size >= 1);
+    assert(size <= BUF_MAX_SIZE);
+
+    buf->size = size;
+    buf->used = 0;
+    buf->head = 0;
+    buf->tail = 0;
 }
 
-int *buf_get_end(const CircularBuffer *const buf) {
-    return buf->buffer + buf->size;
+void buf_destroy(CircularBuffer *const buf) {
+    free(buf);
 }
 
 bool buf_is_full(const CircularBuffer *const buf) {
@@ -56,9 +50,9 @@ int buf_add_head(CircularBuffer *const buf, const int val) {
         return -1;
     }
     buf->used++;
-    *buf->head++ = val;
-    if (buf->head == buf_get_end(buf))
-        buf->head = buf->buffer;
+    buf->buffer[buf->head++] = val;
+    if (buf->head == buf->size)
+        buf->head = 0;
     return 0;
 }
 
@@ -68,11 +62,11 @@ int buf_add_tail(CircularBuffer *const buf, const int val) {
         return -1;
     }
     buf->used++;
-    if (buf->tail == buf->buffer)
-        buf->tail = buf_get_end(buf)-1;
+    if (buf->tail == 0)
+        buf->tail = buf->size-1;
     else
         buf->tail--;
-    *buf->tail = val;
+    buf->buffer[buf->tail] = val;
     return 0;
 }
 
@@ -81,13 +75,9 @@ int buf_get_head(const CircularBuffer *const buf, const int offset) {
     assert(offset >= 0);
     assert((size_t)offset < buf->used);
 
-    const ptrdiff_t diff = buf->head - buf->buffer;
-    if (diff > offset) {
-        return *(buf->head-1 - offset);
-    } else {
-        const int left = offset - diff;
-        return *(buf_get_end(buf)-1 - left);
-    }
+    if (buf->head > (size_t)offset)
+        return buf->buffer[buf->head-1 - offset];
+    return buf->buffer[buf->size-1 - (offset - buf->head)];
 }
 
 int buf_get_tail(const CircularBuffer *const buf, const int offset) {
@@ -99,11 +89,10 @@ void buf_remove_head(CircularBuffer *const buf) {
         fprintf(stderr, "buf is empty can remove head!\n");
         exit(EXIT_FAILURE);
     }
-    if (buf->head == buf->buffer) {
-        buf->head = buf_get_end(buf)-1;
-    } else {
+    if (buf->head == 0)
+        buf->head = buf->size-1;
+    else
         buf->head--;
-    }
 }
 
 void buf_remove_tail(CircularBuffer *const buf) {
@@ -111,7 +100,6 @@ void buf_remove_tail(CircularBuffer *const buf) {
         fprintf(stderr, "buf is empty can remove head!\n");
         exit(EXIT_FAILURE);
     }
-    if (buf->tail++ == buf_get_end(buf)) {
-        buf->tail = buf->buffer;
-    }
+    if (++buf->tail == buf->size)
+        buf->tail = 0;
 }
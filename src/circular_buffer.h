@@ -4,17 +4,21 @@
 #include <stddef.h>
 #include <stdbool.h>
 
+#define BUF_MAX_SIZE 16
+
+/* The values are stored inline and head/tail are indices instead of
+ * pointers so a buffer can be copied around with memcpy. */
 typedef struct CircularBuffer {
     size_t size;
     size_t used;
-    int *buffer;
-    int *head;
-    int *tail;
+    size_t head;
+    size_t tail;
+    int buffer[BUF_MAX_SIZE];
 } CircularBuffer;
 
 CircularBuffer *buf_create(const size_t size);
+void buf_init(CircularBuffer *const buf, const size_t size);
 void buf_destroy(CircularBuffer *const buf);
-int *buf_get_end(const CircularBuffer *const buf);
 bool buf_is_full(const CircularBuffer *const buf);
 int buf_add_head(CircularBuffer *const buf, const int val);
 int buf_add_tail(CircularBuffer *const buf, const int val);
@@ -21,6 +21,7 @@ Debug *debug_create(const size_t size, const size_t max_line_len) {
     debug->max_lines = size;
     debug->max_line_length = max_line_len;
     debug->nolines = 0;
+    debug->generation = 0;
 
     debug->lines = malloc(sizeof(char *) * debug->max_lines);
     if (debug->lines == NULL) {
@@ -64,6 +65,7 @@ void debug_add_string(Debug *const debug, const char *s) {
     }
 
     strcpy(debug->lines[new_index], s);
+    debug->generation++;
 }
 
 void debug(char *s, ...) {
@@ -90,9 +92,29 @@ void debug(char *s, ...) {
 void show_debug(void) {
     if (debug_ctx == NULL)
         return;
-    werase(debug_ctx->debug_window->win);
-    render_debug(debug_ctx->debug_window, debug_ctx->debug);
-    wrefresh(debug_ctx->debug_window->win);
+    Window *window = debug_ctx->debug_window;
+    debug_ctx->shown_generation = debug_ctx->debug->generation;
+    window_clear(window);
+    render_debug(window, debug_ctx->debug);
+    window_print(window,
+            1,
+            window->height - 1,
+            "last frame: %lld bytes, %lld writes, %lld us",
+            debug_ctx->frame_io.bytes,
+            debug_ctx->frame_io.writes,
+            debug_ctx->frame_io.ns / 1000);
+    // The main loop clears the screen between states, all of the window
+    // has to be copied again and not only what changed.
+    touchwin(window->win);
+    // goes out with the next doupdate, render_present or a wrefresh
+    render_stage(window);
+}
+
+/* Whether there are lines show_debug hasn't drawn yet. */
+bool debug_changed(void) {
+    if (debug_ctx == NULL)
+        return false;
+    return debug_ctx->shown_generation != debug_ctx->debug->generation;
 }
 
 void init_debug_ctx(void) {
@@ -103,6 +125,8 @@ void init_debug_ctx(void) {
     }
 
     debug_ctx->debug = debug_create(10, 80);
+    debug_ctx->frame_io = (TerminalIo){ 0 };
+    debug_ctx->shown_generation = 0;
     debug_ctx->debug_window = create_window_for_debug(
             debug_ctx->debug, 20, 30);
 }
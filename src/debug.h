@@ -1,9 +1,11 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include "circular_buffer.h"
+#include "terminal.h"
 #include "window.h"
 
 typedef struct Debug {
@@ -12,11 +14,17 @@ typedef struct Debug {
     size_t nolines;
     size_t max_lines;
     size_t max_line_length;
+    // goes up with every new line
+    unsigned generation;
 } Debug;
 
 typedef struct DebugCtx {
     Window *debug_window;
     Debug *debug;
+    // what putting the last frame on the terminal cost
+    TerminalIo frame_io;
+    // Debug.generation of the lines show_debug last drew
+    unsigned shown_generation;
 } DebugCtx;
 
 extern DebugCtx *debug_ctx;
@@ -26,6 +34,7 @@ Debug *debug_create(const size_t size, const size_t max_line_len);
 void debug_add_string(Debug *const debug, const char *s);
 void debug(char *s, ...);
 void show_debug(void);
+bool debug_changed(void);
 void uninit_debug_ctx(void);
 void init_debug_ctx(void);
 
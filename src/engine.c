@@ -0,0 +1,585 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "block.h"
+#include "board.h"
+#include "circular_buffer.h"
+#include "engine.h"
+
+/* The seed is all that's needed to replay a game with the same inputs. */
+void engine_init(
+        BoardCtx *const board,
+        GameCtx *const game,
+        const uint64_t seed) {
+    *game = (GameCtx) {
+        .fps_counter = 0,
+        .cleared = 0,
+        .move_ret = 0,
+        .swap = false,
+        .to_swap = BLOCK_EMPTY,
+        .last_fall = 0,
+        .quit = false,
+        .handling = default_handling
+    };
+    engine_release_keys(game);
+    seven_bag_init(&game->bag, seed);
+
+    *board = (BoardCtx) {
+        .block = {
+            .x = SPAWN_X,
+            .y = SPAWN_Y,
+            .rot = UP,
+            .type = seven_bag_get(&game->bag)
+        },
+        .stats = (Stats) {
+            .rows = 0,
+            .blocks = 0,
+            .combo = 0,
+            .level = 1,
+            .score = 0
+        },
+        .hold = (HoldBox) {
+            .swapped = false,
+            .curr_type = BLOCK_EMPTY
+        },
+        .lock_piece_delay = default_lock_piece_delay,
+        .block_out = false,
+        .lock_out = false
+    };
+    board_init(&board->board, BOARD_WIDTH, BOARD_HEIGHT);
+    buf_init(&board->buf, STD_BUF_SIZE);
+
+    for (size_t i = 0; i < board->buf.size; i++)
+        buf_add_head(&board->buf, seven_bag_get(&game->bag));
+}
+
+/* The level multiplies the points for cleared rows and it comes from the
+ * score, so the score grows exponentially in long games. It stops at
+ * INT_MAX instead of overflowing. */
+static void stats_add_score(Stats *const stats, const long long points) {
+    const long long score = stats->score + points;
+    stats->score = score < INT_MAX ? score : INT_MAX;
+}
+
+/* Something visible changed, see BoardCtx.generation. */
+static void engine_changed(BoardCtx *const board) {
+    board->generation++;
+}
+
+/* move_ret is 0 when any move or rotation since the last frame worked,
+ * with many inputs in a frame a failed one doesn't hide the ones before
+ * it from the lock delay. */
+static void engine_moved(BoardCtx *const board, GameCtx *const game, const int ret) {
+    if (ret == 0) {
+        game->move_ret = 0;
+        engine_changed(board);
+    }
+}
+
+void engine_input(BoardCtx *const board, GameCtx *const game, const Input input) {
+    switch (input) {
+    case INPUT_HOLD:
+        if (!board->hold.swapped) {
+            game->to_swap = board->hold.curr_type;
+            board->hold.curr_type = board->block.type;
+            board->hold.swapped = true;
+            game->swap = true;
+            engine_changed(board);
+        }
+        break;
+    case INPUT_LEFT:
+        engine_moved(board, game, block_move(&board->block, &board->board, -1, 0));
+        break;
+    case INPUT_RIGHT:
+        engine_moved(board, game, block_move(&board->block, &board->board, 1, 0));
+        break;
+    case INPUT_SOFT_DROP:
+        game->cleared |= fall(&board->block, &board->board);
+        game->last_fall = game->fps_counter;
+        engine_changed(board);
+        break;
+    case INPUT_ROTATE_CW:
+        engine_moved(board, game, block_rotate_cw(&board->block, &board->board));
+        break;
+    case INPUT_ROTATE_CCW:
+        engine_moved(board, game, block_rotate_ccw(&board->block, &board->board));
+        break;
+    case INPUT_ROTATE_180:
+        engine_moved(board, game, block_rotate_180(&board->block, &board->board));
+        break;
+    case INPUT_HARD_DROP:
+        // hard drop points
+        stats_add_score(&board->stats, 2 * block_get_cell_amount(board->block.type));
+        board->block = cast_block_shadow(&board->block, &board->board);
+        game->cleared |= fall(&board->block, &board->board);
+        game->last_fall = game->fps_counter;
+        engine_changed(board);
+        break;
+    case INPUT_QUIT:
+        game->quit = true;
+        break;
+    default:
+        break;
+    }
+}
+
+/* A key going down or up. Pressing does the same as engine_input and the
+ * sideways keys and soft drop then repeat every frame they stay held, see
+ * Handling. */
+void engine_key(
+        BoardCtx *const board,
+        GameCtx *const game,
+        const Input input,
+        const bool pressed) {
+    HeldKeys *held = &game->held;
+    switch (input) {
+    case INPUT_LEFT:
+    case INPUT_RIGHT:
+        if (input == INPUT_LEFT)
+            held->left = pressed;
+        else
+            held->right = pressed;
+        if (pressed) {
+            held->shift = input;
+            held->shift_frames = 0;
+        } else if (held->shift == input) {
+            // the other one takes over if it's still held, its DAS starts
+            // over without a tap
+            held->shift = held->left ? INPUT_LEFT :
+                held->right ? INPUT_RIGHT : INPUT_NONE;
+            held->shift_frames = 0;
+        }
+        break;
+    case INPUT_SOFT_DROP:
+        held->soft_drop = pressed;
+        held->soft_drop_progress = 0;
+        break;
+    default:
+        break;
+    }
+    if (pressed)
+        engine_input(board, game, input);
+}
+
+/* Forgets every held key, they have to be pressed again to repeat. */
+void engine_release_keys(GameCtx *const game) {
+    game->held = (HeldKeys){ .shift = INPUT_NONE };
+}
+
+/* Repeats the held keys, called every frame before anything else. */
+static void engine_repeat_held(BoardCtx *const board, GameCtx *const game) {
+    const Handling *handling = &game->handling;
+    HeldKeys *held = &game->held;
+    if (board->block.type == BLOCK_EMPTY)
+        return;
+
+    if (held->shift != INPUT_NONE) {
+        const int dir = held->shift == INPUT_LEFT ? -1 : 1;
+        held->shift_frames++;
+        if (held->shift_frames >= handling->das) {
+            if (handling->arr == 0) {
+                engine_moved(
+                        board,
+                        game,
+                        block_shift_to_wall(&board->block, &board->board, dir));
+            } else if ((held->shift_frames - handling->das) % handling->arr == 0) {
+                engine_moved(
+                        board,
+                        game,
+                        block_move(&board->block, &board->board, dir, 0));
+            }
+        }
+    }
+
+    if (held->soft_drop) {
+        // Only falls as far as the ground, locking is left to the lock
+        // delay like with gravity.
+        const int distance = block_drop_distance(&board->block, &board->board);
+        int rows = distance;
+        if (handling->sdf > 0) {
+            const int fall_after = get_fall_after(board->stats.level);
+            held->soft_drop_progress += handling->sdf;
+            rows = held->soft_drop_progress / fall_after;
+            held->soft_drop_progress %= fall_after;
+            if (rows > distance)
+                rows = distance;
+        }
+        if (rows > 0) {
+            board->block.y += rows;
+            game->last_fall = game->fps_counter;
+            engine_changed(board);
+        }
+    }
+}
+
+/* Advances the game by one frame. Returns true when the game is over. */
+bool engine_logic(BoardCtx *const board, GameCtx *const game) {
+    engine_repeat_held(board, game);
+
+    // get the delta time that a block should fall after
+    int fall_after = get_fall_after(board->stats.level);
+
+    // if block is on ground use the lock piece delay left frames instead
+    // of last fall and fps counter
+    if (is_block_on_ground(&board->block, &board->board)) {
+        board->lock_piece_delay.left_frames--;
+        game->last_fall = game->fps_counter;
+        engine_changed(board);
+    }
+
+    // if block moved update lock piece delay
+    if (!game->move_ret) {
+        board->lock_piece_delay.left_frames = LOCK_DEFAULT_FRAMES;
+        board->lock_piece_delay.left_moves--;
+        engine_changed(board);
+    }
+
+    // if no more left frames or moves from piece delay then drop the piece
+    if (board->lock_piece_delay.left_frames <= 0 || 
+            (is_block_on_ground(&board->block, &board->board) &&
+             board->lock_piece_delay.left_moves <= 0)) {
+        // a hack so the block would fall instantly
+        game->last_fall = -fall_after;
+        // soft drop points
+        stats_add_score(&board->stats, 1 * block_get_cell_amount(board->block.type));
+        engine_changed(board);
+    }
+
+    // drop block after certain time of not falling
+    if (game->fps_counter >= game->last_fall+fall_after) {
+        game->cleared |= fall(&board->block, &board->board);
+        game->last_fall = game->fps_counter;
+        engine_changed(board);
+    }
+
+    // create (or get from swap) a new block
+    if (board->block.type == BLOCK_EMPTY || game->swap) {
+        game->last_fall = game->fps_counter;
+        board->lock_piece_delay = default_lock_piece_delay;
+
+        board->block = (Block){
+                .x = SPAWN_X,
+                .y = SPAWN_Y,
+                .rot = UP,
+                .type = game->swap ? game->to_swap : BLOCK_EMPTY
+        };
+        // get a new block from the buffer
+        if (board->block.type == BLOCK_EMPTY) {
+            board->block.type = buf_get_head(&board->buf, 0);
+            board->stats.blocks += 1;
+            if (!game->swap)
+                board->hold.swapped = false;
+            buf_remove_head(&board->buf);
+            buf_add_tail(&board->buf, seven_bag_get(&game->bag));
+
+            if (game->cleared)
+                board->stats.combo += 1;
+            else
+                board->stats.combo = 0;
+        }
+
+        // Check if can put a new block. If not the game is lost.
+        board->block_out = !block_find_spawn(&board->block, &board->board);
+        engine_changed(board);
+    }
+
+    // if there's a block in FIRST_TRUE_ROW-2 then game over.
+    if (board->board.rows[FIRST_TRUE_ROW-2] != 0)
+        board->lock_out = true;
+
+    // game over
+    if (board->lock_out || board->block_out) {
+        game->quit = true;
+        return true;
+    }
+
+    // don't reset lock piece delay when the block was already on this height
+    if (board->lock_piece_delay.lowest < board->block.y) {
+        board->lock_piece_delay = default_lock_piece_delay;
+        board->lock_piece_delay.lowest = board->block.y;
+        engine_changed(board);
+    }
+
+    // update variables
+    stats_update(&board->stats, game->cleared);
+    game->fps_counter++;
+    game->cleared = 0;
+    game->swap = false;
+    game->move_ret = -1;
+    return false;
+}
+
+/* Applies the inputs in order and then advances the game by one frame.
+ * Returns true when the game is over. */
+bool engine_step(
+        BoardCtx *const board,
+        GameCtx *const game,
+        const Input *const inputs,
+        const size_t n) {
+    for (size_t i = 0; i < n; i++)
+        engine_input(board, game, inputs[i]);
+    return engine_logic(board, game);
+}
+
+/* Moves the block down a row or bakes it when it can't, returns the rows
+ * that got cleared like bake. */
+uint64_t fall(Block *const block, Board *const board) {
+    uint64_t cleared = 0;
+    int ret = block_move(block, board, 0, 1);
+    if (ret != 0) {
+        cleared = bake(block, board);
+        block->type = BLOCK_EMPTY;
+    }
+    return cleared;
+}
+
+/* Puts the block on the board and clears the full rows. Returns them with
+ * the bit y set for the row y as it was before the clear. */
+uint64_t bake(Block *const block, Board *const board) {
+    const PieceMask *mask = block_get_mask(block->type, block->rot);
+    for (int y = mask->min_y; y <= mask->max_y; y++) {
+        board_fill_row(
+                board,
+                block->y+y,
+                piece_mask_row_at(mask, y, block->x),
+                block->type);
+    }
+    uint64_t cleared;
+    board_clear_full_rows(board, &cleared);
+    return cleared;
+}
+
+bool block_can_move(
+        const Block *const block,
+        const Board *const board,
+        const int mov_x,
+        const int mov_y) {
+    const PieceMask *mask = block_get_mask(block->type, block->rot);
+    const int x = block->x + mov_x;
+    const int y = block->y + mov_y;
+    if (x + mask->min_x < 0 || x + mask->max_x >= board->width)
+        return false;
+    if (y + mask->min_y < 0 || y + mask->max_y >= board->height)
+        return false;
+    for (int tile_y = mask->min_y; tile_y <= mask->max_y; tile_y++) {
+        if (board->rows[y+tile_y] & piece_mask_row_at(mask, tile_y, x))
+            return false;
+    }
+    return true;
+}
+
+/* Moves a freshly spawned block up until it fits, at most 3 rows. Returns
+ * false if it doesn't fit anywhere which means the game is lost. */
+bool block_find_spawn(Block *const block, const Board *const board) {
+    for (int i = 0; i < 4; i++) {
+        if (block_can_move(block, board, 0, 0))
+            return true;
+        block->y += -1;
+    }
+    return false;
+}
+
+int block_move(
+        Block *const block,
+        const Board *const board,
+        const int x,
+        const int y) {
+    if (block_can_move(block, board, x, y)) {
+        block->x += x;
+        block->y += y;
+        return 0;
+    }
+    return -1;
+}
+
+static int block_rotate(
+        Block *const block,
+        const Board *const board,
+        const Rotation to) {
+    const Block orig = *block;
+    block->rot = to;
+    if (block_wallkick(block, board, orig.rot) == 0)
+        return 0;
+    *block = orig;
+    return -1;
+}
+
+int block_rotate_cw(Block *const block, const Board *const board) {
+    return block_rotate(block, board, (block->rot+1) % ROTATION_MAX);
+}
+
+int block_rotate_ccw(Block *const block, const Board *const board) {
+    return block_rotate(
+            block,
+            board,
+            (block->rot+ROTATION_MAX-1) % ROTATION_MAX);
+}
+
+int block_rotate_180(Block *const block, const Board *const board) {
+    return block_rotate(block, board, (block->rot+2) % ROTATION_MAX);
+}
+
+/* Expects the block to be already in its new rotation but still in the
+ * position from before the rotation. */
+int block_wallkick(
+        Block *const block,
+        const Board *const board,
+        const Rotation from) {
+    const Wallkick *kick = block_get_wallkick(block->type, from, block->rot);
+    for (int i = 0; i < kick->tests; i++) {
+        if (block_move(block, board, kick->moves[i].x, kick->moves[i].y) == 0)
+            return 0;
+    }
+    return -1;
+}
+
+/* Returns how many rows the block can fall. When the block is above the
+ * skyline in all of its columns it's just the smallest gap between the
+ * block's bottom and the column tops. Otherwise it's tucked under some
+ * overhang and has to be moved down row by row. */
+int block_drop_distance(const Block *const block, const Board *const board) {
+    if (block->type == BLOCK_EMPTY)
+        return 0;
+
+    const PieceMask *mask = block_get_mask(block->type, block->rot);
+    int distance = board->height;
+    for (int x = mask->min_x; x <= mask->max_x; x++) {
+        if (mask->bottom[x] < 0)
+            continue;
+        const int bottom = block->y + mask->bottom[x];
+        const int top = board_get_column_top(board, block->x + x);
+        if (bottom >= top) {
+            distance = 0;
+            while (block_can_move(block, board, 0, distance+1))
+                distance++;
+            return distance;
+        }
+        if (top - bottom - 1 < distance)
+            distance = top - bottom - 1;
+    }
+    return distance;
+}
+
+/* Returns how many columns the block can move in the direction dir (-1 left,
+ * 1 right) without going through anything. Every row of every block is a
+ * single run of tiles so a row can move up to the nearest occupied tile (or
+ * wall) next to its run, the block as far as its tightest row. */
+int block_shift_distance(
+        const Block *const block,
+        const Board *const board,
+        const int dir) {
+    if (block->type == BLOCK_EMPTY)
+        return 0;
+
+    const PieceMask *mask = block_get_mask(block->type, block->rot);
+    int distance = board->width;
+    for (int y = mask->min_y; y <= mask->max_y; y++) {
+        const uint32_t piece = piece_mask_row_at(mask, y, block->x);
+        const uint32_t row = board->rows[block->y + y];
+        if (piece == 0)
+            continue;
+        int free;
+        if (dir < 0) {
+            const int first = __builtin_ctz(piece);
+            const uint32_t blocked = row & ((1u << first) - 1);
+            free = blocked ? first - (31 - __builtin_clz(blocked)) - 1 : first;
+        } else {
+            const int last = 31 - __builtin_clz(piece);
+            const uint32_t blocked = row & ~((2u << last) - 1);
+            free = blocked ? __builtin_ctz(blocked) - last - 1 : board->width - 1 - last;
+        }
+        if (free < distance)
+            distance = free;
+    }
+    return distance;
+}
+
+/* Moves the block to the wall (or whatever is in the way) in one step.
+ * Returns -1 when it can't move at all, like block_move. */
+int block_shift_to_wall(Block *const block, const Board *const board, const int dir) {
+    const int distance = block_shift_distance(block, board, dir);
+    if (distance == 0)
+        return -1;
+    block->x += dir * distance;
+    return 0;
+}
+
+Block cast_block_shadow(const Block *const block, const Board *const board) {
+    Block shadow = *block;
+    shadow.y += block_drop_distance(block, board);
+    return shadow;
+}
+
+bool is_block_on_ground(const Block *const block, const Board *const board) {
+    if (block->type == BLOCK_EMPTY)
+        return false;
+    return !block_can_move(block, board, 0, 1);
+}
+
+/* cleared is a mask of the rows cleared this frame like bake returns. */
+void stats_update(Stats *const stats, const uint64_t cleared) {
+    const int cleared_rows = __builtin_popcountll(cleared);
+    stats->rows += cleared_rows;
+    switch (cleared_rows) {
+        case 0:
+            break;
+        case 1:
+            stats_add_score(stats, 100LL * stats->level);
+            break;
+        case 2:
+            stats_add_score(stats, 300LL * stats->level);
+            break;
+        case 3:
+            stats_add_score(stats, 500LL * stats->level);
+            break;
+        case 4:
+            stats_add_score(stats, 800LL * stats->level);
+            break;
+        default:
+            fprintf(stderr, "cleared rows weird number\n");
+            exit(EXIT_FAILURE);
+    }
+    if (cleared_rows)
+        stats_add_score(stats, 50LL * stats->combo * stats->level);
+    stats->level = get_level(stats->score);
+}
+
+int get_fall_after(const int level) {
+    if (level == 1)
+        return FALL_AFTER_LEVEL1;
+    if (level == 2)
+        return FALL_AFTER_LEVEL2;
+    if (level == 3)
+        return FALL_AFTER_LEVEL3;
+    if (level == 4)
+        return FALL_AFTER_LEVEL4;
+    if (level == 5)
+        return FALL_AFTER_LEVEL5;
+    if (level == 6)
+        return FALL_AFTER_LEVEL6;
+    if (level == 7)
+        return FALL_AFTER_LEVEL7;
+    if (level == 8)
+        return FALL_AFTER_LEVEL8;
+    if (level == 9)
+        return FALL_AFTER_LEVEL9;
+    if (level == 10)
+        return FALL_AFTER_LEVEL10;
+    if (level >= 11 && level <= 13)
+        return FALL_AFTER_LEVEL11;
+    if (level >= 14 && level <= 16)
+        return FALL_AFTER_LEVEL14;
+    if (level >= 17 && level <= 19)
+        return FALL_AFTER_LEVEL17;
+    if (level >= 20 && level <= 29)
+        return FALL_AFTER_LEVEL20;
+    if (level >= 30)
+        return FALL_AFTER_LEVEL30;
+    fprintf(stderr, "wrong level\n");
+    exit(EXIT_FAILURE);
+}
+
+int get_level(const int score) {
+    return score / 2500 + 1;
+}
@@ -0,0 +1,220 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block.h"
+#include "board.h"
+#include "circular_buffer.h"
+
+/* The game rules. Nothing in here (and in the block, board and circular
+ * buffer modules it's built on) knows about curses, sockets or any global
+ * state so it can be linked on its own as libtetris-core.a. */
+
+#define FPS 60
+
+#define FALL_AFTER_LEVEL1 48
+#define FALL_AFTER_LEVEL2 43
+#define FALL_AFTER_LEVEL3 38
+#define FALL_AFTER_LEVEL4 33
+#define FALL_AFTER_LEVEL5 28
+#define FALL_AFTER_LEVEL6 23
+#define FALL_AFTER_LEVEL7 18
+#define FALL_AFTER_LEVEL8 13
+#define FALL_AFTER_LEVEL9 8
+#define FALL_AFTER_LEVEL10 6
+#define FALL_AFTER_LEVEL11 5
+#define FALL_AFTER_LEVEL14 4
+#define FALL_AFTER_LEVEL17 3
+#define FALL_AFTER_LEVEL20 2
+#define FALL_AFTER_LEVEL30 1
+// Blocks don't fall any faster after this level.
+#define FASTEST_LEVEL 30
+
+#define BOARD_HEIGHT 40
+#define BOARD_WIDTH 10
+#define FIRST_TRUE_ROW 20
+
+// because the board row is of size 10 and blocks are of size 4
+// x = 3 is the middle of the board for blocks.
+#define SPAWN_X 3
+#define SPAWN_Y FIRST_TRUE_ROW
+
+#define LOCK_DEFAULT_MOVES 15
+#define LOCK_DEFAULT_FRAMES 30
+#define LOCK_DEFUALT_LOWEST 0
+
+#define STD_BUF_SIZE 6
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct Stats {
+    int rows;
+    int blocks;
+    int combo;
+    int level;
+    int score;
+} Stats;
+
+typedef struct HoldBox {
+    bool swapped;
+    BlockType curr_type;
+} HoldBox;
+
+typedef struct LockPieceDelay {
+    int left_moves;
+    int left_frames;
+    int lowest;
+} LockPieceDelay;
+
+static const LockPieceDelay default_lock_piece_delay = {
+    LOCK_DEFAULT_MOVES,
+    LOCK_DEFAULT_FRAMES,
+    LOCK_DEFUALT_LOWEST
+};
+
+// This ctx struct is for board related things. In the case of multiplayer
+// there will be multiple of those for each player and every board will be
+// send to and received from server.
+// Everything is stored inline so the whole thing can be copied with memcpy.
+// Fields touched every frame come first, stats that only change when a
+// block gets baked are on their own cache line at the end.
+typedef struct BoardCtx {
+    _Alignas(CACHE_LINE_SIZE) Block block;
+    LockPieceDelay lock_piece_delay;
+    HoldBox hold;
+    bool block_out;
+    bool lock_out;
+    // Changes whenever something that gets drawn does (the board, the
+    // block, the queue, the hold box, the stats or the lock delay), while
+    // it stays the same there's nothing new to draw.
+    uint32_t generation;
+    CircularBuffer buf;
+    Board board;
+    _Alignas(CACHE_LINE_SIZE) Stats stats;
+} BoardCtx;
+
+// Actions a player (or anything else driving the engine) can take.
+typedef enum Input {
+    INPUT_NONE,
+    INPUT_LEFT,
+    INPUT_RIGHT,
+    INPUT_SOFT_DROP,
+    INPUT_HARD_DROP,
+    INPUT_ROTATE_CW,
+    INPUT_ROTATE_CCW,
+    INPUT_ROTATE_180,
+    INPUT_HOLD,
+    INPUT_QUIT,
+    INPUT_MAX
+} Input;
+
+// How held keys repeat. Everything is in frames because that's what the
+// engine steps in.
+typedef struct Handling {
+    // frames a sideways key has to be held before it starts repeating
+    // (delayed auto shift)
+    int das;
+    // frames between the repeats after that (auto repeat rate), 0 moves
+    // the block straight to the wall
+    int arr;
+    // a held soft drop falls this many times faster than gravity, 0 drops
+    // to the ground at once (without locking)
+    int sdf;
+} Handling;
+
+static const Handling default_handling = {
+    10,
+    2,
+    20
+};
+
+// Keys that are held down. Only engine_key presses and releases keys,
+// engine_input is a tap so nothing is ever held with it.
+typedef struct HeldKeys {
+    bool left;
+    bool right;
+    bool soft_drop;
+    // INPUT_LEFT, INPUT_RIGHT or INPUT_NONE, the last pressed one wins
+    // when both are held
+    Input shift;
+    int shift_frames;
+    // gravity frames the soft drop got ahead by, a row falls for every
+    // fall_after of them
+    int soft_drop_progress;
+} HeldKeys;
+
+// This ctx struct is keeping the game state.
+typedef struct GameCtx {
+    SevenBag bag;
+    long long fps_counter;
+    // rows cleared this frame, bit y for the row y as it was before the
+    // clear
+    uint64_t cleared;
+    int move_ret;
+    bool swap;
+    BlockType to_swap;
+    long long last_fall;
+    bool quit;
+    Handling handling;
+    HeldKeys held;
+} GameCtx;
+
+void engine_init(
+        BoardCtx *const board,
+        GameCtx *const game,
+        const uint64_t seed);
+void engine_input(BoardCtx *const board, GameCtx *const game, const Input input);
+void engine_key(
+        BoardCtx *const board,
+        GameCtx *const game,
+        const Input input,
+        const bool pressed);
+void engine_release_keys(GameCtx *const game);
+bool engine_logic(BoardCtx *const board, GameCtx *const game);
+bool engine_step(
+        BoardCtx *const board,
+        GameCtx *const game,
+        const Input *const inputs,
+        const size_t n);
+
+uint64_t fall(Block *const block, Board *const board);
+uint64_t bake(Block *const block, Board *const board);
+// Those block functions should be in block.c/block.h instead but becuase
+// they use both Block and Board in the declaration the compiler throws an
+// error when I put them there. Its happening because of headers including
+// each other.
+bool block_can_move(
+        const Block *const block,
+        const Board *const board,
+        const int mov_x,
+        const int mov_y);
+bool block_find_spawn(Block *const block, const Board *const board);
+int block_move(
+        Block *const block,
+        const Board *const board,
+        const int x,
+        const int y);
+int block_rotate_cw(Block *const block, const Board *const board);
+int block_rotate_ccw(Block *const block, const Board *const board);
+int block_rotate_180(Block *const block, const Board *const board);
+int block_wallkick(
+        Block *const block,
+        const Board *const board,
+        const Rotation from);
+int block_drop_distance(const Block *const block, const Board *const board);
+int block_shift_distance(
+        const Block *const block,
+        const Board *const board,
+        const int dir);
+int block_shift_to_wall(Block *const block, const Board *const board, const int dir);
+Block cast_block_shadow(const Block *const block, const Board *const board);
+bool is_block_on_ground(const Block *const block, const Board *const board);
+
+void stats_update(Stats *const stats, const uint64_t cleared);
+int get_fall_after(const int level);
+int get_level(const int score);
+
+#endif
@@ -0,0 +1,476 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "block.h"
+#include "engine.h"
+#include "env_batch.h"
+
+#define ENV_FULL_ROW ((1 << BOARD_WIDTH) - 1)
+
+_Static_assert(FASTEST_LEVEL == 30, "fall_after_table lists the levels up to 30");
+_Static_assert(BLOCK_MAX == 8, "cell_amounts lists every block");
+
+// get_fall_after, stats_update and block_get_cell_amount as tables so
+// the passes over the games don't branch on them, levels past the table
+// fall like its last one
+static const int32_t fall_after_table[FASTEST_LEVEL + 1] = {
+    [1] = FALL_AFTER_LEVEL1,
+    [2] = FALL_AFTER_LEVEL2,
+    [3] = FALL_AFTER_LEVEL3,
+    [4] = FALL_AFTER_LEVEL4,
+    [5] = FALL_AFTER_LEVEL5,
+    [6] = FALL_AFTER_LEVEL6,
+    [7] = FALL_AFTER_LEVEL7,
+    [8] = FALL_AFTER_LEVEL8,
+    [9] = FALL_AFTER_LEVEL9,
+    [10] = FALL_AFTER_LEVEL10,
+    FALL_AFTER_LEVEL11, FALL_AFTER_LEVEL11, FALL_AFTER_LEVEL11,
+    FALL_AFTER_LEVEL14, FALL_AFTER_LEVEL14, FALL_AFTER_LEVEL14,
+    FALL_AFTER_LEVEL17, FALL_AFTER_LEVEL17, FALL_AFTER_LEVEL17,
+    FALL_AFTER_LEVEL20, FALL_AFTER_LEVEL20, FALL_AFTER_LEVEL20,
+    FALL_AFTER_LEVEL20, FALL_AFTER_LEVEL20, FALL_AFTER_LEVEL20,
+    FALL_AFTER_LEVEL20, FALL_AFTER_LEVEL20, FALL_AFTER_LEVEL20,
+    FALL_AFTER_LEVEL20,
+    FALL_AFTER_LEVEL30
+};
+static const int32_t clear_points[5] = { 0, 100, 300, 500, 800 };
+static const int32_t cell_amounts[BLOCK_MAX] = { 0, 4, 4, 4, 4, 4, 4, 4 };
+
+static int env_find_drop(const EnvBatch *const batch, const int i);
+
+/* stats_add_score, the score stops at INT32_MAX. */
+static inline int32_t env_add_score(const int32_t score, const int64_t points) {
+    const int64_t sum = score + points;
+    return sum < INT32_MAX ? sum : INT32_MAX;
+}
+
+/* Hands out the next bytes of the arena, a cursor starting at 0 just
+ * counts how big the arena has to be. */
+static void *env_batch_carve(uintptr_t *const cursor, const size_t bytes) {
+    void *ret = (void *)*cursor;
+    *cursor += (bytes + CACHE_LINE_SIZE - 1) & ~(uintptr_t)(CACHE_LINE_SIZE - 1);
+    return ret;
+}
+
+static uintptr_t env_batch_layout(EnvBatch *const batch, uintptr_t cursor) {
+    const size_t n = batch->count;
+    int32_t **arrays[] = {
+        &batch->block.x,
+        &batch->block.y,
+        &batch->block.rot,
+        &batch->block.type,
+        &batch->lock_piece_delay.left_moves,
+        &batch->lock_piece_delay.left_frames,
+        &batch->lock_piece_delay.lowest,
+        &batch->stats.rows,
+        &batch->stats.blocks,
+        &batch->stats.combo,
+        &batch->stats.level,
+        &batch->stats.score,
+        &batch->hold_type,
+        &batch->hold_swapped,
+        &batch->fps_counter,
+        &batch->last_fall,
+        &batch->rows2add,
+        &batch->move_ret,
+        &batch->swap,
+        &batch->to_swap,
+        &batch->drop_y,
+        &batch->falls,
+        &batch->over
+    };
+    batch->rows = env_batch_carve(&cursor, n * BOARD_HEIGHT * sizeof(uint16_t));
+    for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+        *arrays[i] = env_batch_carve(&cursor, n * sizeof(int32_t));
+    batch->queue = env_batch_carve(&cursor, n * STD_BUF_SIZE);
+    batch->bags = env_batch_carve(&cursor, n * sizeof(SevenBag));
+    return cursor;
+}
+
+/* Game i is seeded with seed+i like in tetris-sim. */
+EnvBatch *env_batch_create(const int count, const uint64_t seed) {
+    assert(count >= 0);
+
+    EnvBatch *ret = malloc(sizeof(EnvBatch));
+    if (ret == NULL) {
+        fprintf(stderr, "Couldn't alloc env batch in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    ret->count = count;
+    const size_t size = env_batch_layout(ret, 0);
+    ret->arena = aligned_alloc(CACHE_LINE_SIZE, size ? size : CACHE_LINE_SIZE);
+    if (ret->arena == NULL) {
+        fprintf(stderr, "Couldn't alloc env arena in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    env_batch_layout(ret, (uintptr_t)ret->arena);
+
+    for (int i = 0; i < count; i++)
+        env_batch_reset(ret, i, seed + i);
+    return ret;
+}
+
+void env_batch_destroy(EnvBatch *const batch) {
+    free(batch->arena);
+    free(batch);
+}
+
+/* Starts the game i over, the same as engine_init. */
+void env_batch_reset(EnvBatch *const batch, const int i, const uint64_t seed) {
+    assert(i >= 0 && i < batch->count);
+
+    SevenBag *bag = &batch->bags[i];
+    seven_bag_init(bag, seed);
+    memset(&batch->rows[i * BOARD_HEIGHT], 0, BOARD_HEIGHT * sizeof(uint16_t));
+    batch->block.x[i] = SPAWN_X;
+    batch->block.y[i] = SPAWN_Y;
+    batch->block.rot[i] = UP;
+    batch->block.type[i] = seven_bag_get(bag);
+    // engine_init adds the preview to the head of the buffer so the last
+    // block added comes first
+    for (int k = STD_BUF_SIZE - 1; k >= 0; k--)
+        batch->queue[i * STD_BUF_SIZE + k] = seven_bag_get(bag);
+
+    batch->lock_piece_delay.left_moves[i] = LOCK_DEFAULT_MOVES;
+    batch->lock_piece_delay.left_frames[i] = LOCK_DEFAULT_FRAMES;
+    batch->lock_piece_delay.lowest[i] = LOCK_DEFUALT_LOWEST;
+    batch->stats.rows[i] = 0;
+    batch->stats.blocks[i] = 0;
+    batch->stats.combo[i] = 0;
+    batch->stats.level[i] = 1;
+    batch->stats.score[i] = 0;
+    batch->hold_type[i] = BLOCK_EMPTY;
+    batch->hold_swapped[i] = false;
+    batch->fps_counter[i] = 0;
+    batch->last_fall[i] = 0;
+    batch->rows2add[i] = 0;
+    batch->move_ret[i] = 0;
+    batch->swap[i] = false;
+    batch->to_swap[i] = BLOCK_EMPTY;
+    batch->drop_y[i] = env_find_drop(batch, i);
+    batch->falls[i] = false;
+    batch->over[i] = false;
+}
+
+const uint16_t *env_batch_get_rows(const EnvBatch *const batch, const int i) {
+    return &batch->rows[i * BOARD_HEIGHT];
+}
+
+/* block_can_move on the row masks of the game i. */
+static bool env_can_move(
+        const EnvBatch *const batch,
+        const int i,
+        const int x,
+        const int y,
+        const Rotation rot) {
+    const PieceMask *mask = block_get_mask(batch->block.type[i], rot);
+    if (x + mask->min_x < 0 || x + mask->max_x >= BOARD_WIDTH)
+        return false;
+    if (y + mask->min_y < 0 || y + mask->max_y >= BOARD_HEIGHT)
+        return false;
+    const uint16_t *rows = &batch->rows[i * BOARD_HEIGHT];
+    for (int tile_y = mask->min_y; tile_y <= mask->max_y; tile_y++) {
+        if (rows[y+tile_y] & piece_mask_row_at(mask, tile_y, x))
+            return false;
+    }
+    return true;
+}
+
+/* cast_block_shadow, the y where the block of the game i lands. The block
+ * is shifted to its column once and then slid down the rows. */
+static int env_find_drop(const EnvBatch *const batch, const int i) {
+    const PieceMask *mask = block_get_mask(batch->block.type[i], batch->block.rot[i]);
+    const uint16_t *rows = &batch->rows[i * BOARD_HEIGHT];
+    uint16_t piece[BLOCK_ARR_DIM];
+    for (int tile_y = mask->min_y; tile_y <= mask->max_y; tile_y++)
+        piece[tile_y] = piece_mask_row_at(mask, tile_y, batch->block.x[i]);
+
+    int y = batch->block.y[i];
+    while (y + 1 + mask->max_y < BOARD_HEIGHT) {
+        for (int tile_y = mask->min_y; tile_y <= mask->max_y; tile_y++) {
+            if (rows[y + 1 + tile_y] & piece[tile_y])
+                return y;
+        }
+        y++;
+    }
+    return y;
+}
+
+/* Only moves sideways, falling is env_fall. */
+static int env_move(EnvBatch *const batch, const int i, const int x) {
+    if (!env_can_move(
+                batch,
+                i,
+                batch->block.x[i] + x,
+                batch->block.y[i],
+                batch->block.rot[i]))
+        return -1;
+    batch->block.x[i] += x;
+    batch->drop_y[i] = env_find_drop(batch, i);
+    return 0;
+}
+
+/* block_rotate with the wall kicks. */
+static int env_rotate(EnvBatch *const batch, const int i, const int turns) {
+    const Rotation from = batch->block.rot[i];
+    const Rotation to = (from + turns) % ROTATION_MAX;
+    const Wallkick *kick = block_get_wallkick(batch->block.type[i], from, to);
+    for (int k = 0; k < kick->tests; k++) {
+        const int x = batch->block.x[i] + kick->moves[k].x;
+        const int y = batch->block.y[i] + kick->moves[k].y;
+        if (env_can_move(batch, i, x, y, to)) {
+            batch->block.x[i] = x;
+            batch->block.y[i] = y;
+            batch->block.rot[i] = to;
+            batch->drop_y[i] = env_find_drop(batch, i);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* bake, only the rows of the block can get full. */
+static int env_bake(EnvBatch *const batch, const int i) {
+    const PieceMask *mask = block_get_mask(batch->block.type[i], batch->block.rot[i]);
+    uint16_t *rows = &batch->rows[i * BOARD_HEIGHT];
+    const int x = batch->block.x[i];
+    const int y = batch->block.y[i];
+    bool full = false;
+    for (int tile_y = mask->min_y; tile_y <= mask->max_y; tile_y++) {
+        rows[y+tile_y] |= piece_mask_row_at(mask, tile_y, x);
+        full |= rows[y+tile_y] == ENV_FULL_ROW;
+    }
+    if (!full)
+        return 0;
+
+    int to = y + mask->max_y;
+    for (int from = to; from >= 0; from--) {
+        if (rows[from] != ENV_FULL_ROW)
+            rows[to--] = rows[from];
+    }
+    const int cleared = to + 1;
+    memset(rows, 0, cleared * sizeof(uint16_t));
+    return cleared;
+}
+
+/* fall */
+static int env_fall(EnvBatch *const batch, const int i) {
+    if (batch->block.y[i] < batch->drop_y[i]) {
+        batch->block.y[i]++;
+        return 0;
+    }
+    const int rows = env_bake(batch, i);
+    batch->block.type[i] = BLOCK_EMPTY;
+    return rows;
+}
+
+/* engine_moved */
+static void env_moved(EnvBatch *const batch, const int i, const int ret) {
+    if (ret == 0)
+        batch->move_ret[i] = 0;
+}
+
+/* engine_input for the game i. */
+static void env_input(EnvBatch *const batch, const int i, const Input input) {
+    switch (input) {
+    case INPUT_HOLD:
+        if (!batch->hold_swapped[i]) {
+            batch->to_swap[i] = batch->hold_type[i];
+            batch->hold_type[i] = batch->block.type[i];
+            batch->hold_swapped[i] = true;
+            batch->swap[i] = true;
+        }
+        break;
+    case INPUT_LEFT:
+        env_moved(batch, i, env_move(batch, i, -1));
+        break;
+    case INPUT_RIGHT:
+        env_moved(batch, i, env_move(batch, i, 1));
+        break;
+    case INPUT_SOFT_DROP:
+        batch->rows2add[i] += env_fall(batch, i);
+        batch->last_fall[i] = batch->fps_counter[i];
+        break;
+    case INPUT_ROTATE_CW:
+        env_moved(batch, i, env_rotate(batch, i, 1));
+        break;
+    case INPUT_ROTATE_CCW:
+        env_moved(batch, i, env_rotate(batch, i, ROTATION_MAX - 1));
+        break;
+    case INPUT_ROTATE_180:
+        env_moved(batch, i, env_rotate(batch, i, 2));
+        break;
+    case INPUT_HARD_DROP:
+        batch->stats.score[i] = env_add_score(
+                batch->stats.score[i],
+                2 * cell_amounts[batch->block.type[i]]);
+        batch->block.y[i] = batch->drop_y[i];
+        batch->rows2add[i] += env_fall(batch, i);
+        batch->last_fall[i] = batch->fps_counter[i];
+        break;
+    case INPUT_QUIT:
+        batch->over[i] = true;
+        break;
+    default:
+        break;
+    }
+}
+
+/* The new block of engine_logic, from the hold box or the queue. Returns
+ * false when it doesn't fit. */
+static bool env_spawn(EnvBatch *const batch, const int i) {
+    batch->last_fall[i] = batch->fps_counter[i];
+    batch->lock_piece_delay.left_moves[i] = LOCK_DEFAULT_MOVES;
+    batch->lock_piece_delay.left_frames[i] = LOCK_DEFAULT_FRAMES;
+    batch->lock_piece_delay.lowest[i] = LOCK_DEFUALT_LOWEST;
+    batch->block.x[i] = SPAWN_X;
+    batch->block.y[i] = SPAWN_Y;
+    batch->block.rot[i] = UP;
+    batch->block.type[i] = batch->swap[i] ? batch->to_swap[i] : BLOCK_EMPTY;
+
+    if (batch->block.type[i] == BLOCK_EMPTY) {
+        uint8_t *queue = &batch->queue[i * STD_BUF_SIZE];
+        batch->block.type[i] = queue[0];
+        batch->stats.blocks[i] += 1;
+        if (!batch->swap[i])
+            batch->hold_swapped[i] = false;
+        memmove(queue, queue + 1, STD_BUF_SIZE - 1);
+        queue[STD_BUF_SIZE - 1] = seven_bag_get(&batch->bags[i]);
+        batch->stats.combo[i] = batch->rows2add[i] ? batch->stats.combo[i] + 1 : 0;
+    }
+
+    // block_find_spawn
+    for (int k = 0; k < 4; k++) {
+        if (env_can_move(batch, i, SPAWN_X, batch->block.y[i], UP)) {
+            batch->drop_y[i] = env_find_drop(batch, i);
+            return true;
+        }
+        batch->block.y[i]--;
+    }
+    return false;
+}
+
+/* Lock delay and gravity timers of every game. No branches, games that
+ * are over get their old values back. */
+static void env_batch_update_timers(EnvBatch *const batch) {
+    const int n = batch->count;
+    const int32_t *restrict y = batch->block.y;
+    const int32_t *restrict type = batch->block.type;
+    const int32_t *restrict drop_y = batch->drop_y;
+    int32_t *restrict left_moves = batch->lock_piece_delay.left_moves;
+    int32_t *restrict left_frames = batch->lock_piece_delay.left_frames;
+    const int32_t *restrict level = batch->stats.level;
+    int32_t *restrict score = batch->stats.score;
+    const int32_t *restrict fps_counter = batch->fps_counter;
+    int32_t *restrict last_fall = batch->last_fall;
+    const int32_t *restrict move_ret = batch->move_ret;
+    int32_t *restrict falls = batch->falls;
+    const int32_t *restrict over = batch->over;
+
+    // gcc doesn't take restrict on locals as proof that the arrays don't
+    // overlap and gives up on versioning this many of them
+#pragma GCC ivdep
+    for (int i = 0; i < n; i++) {
+        const int32_t fall_after =
+            fall_after_table[level[i] < FASTEST_LEVEL ? level[i] : FASTEST_LEVEL];
+        const int32_t live = !over[i];
+        // is_block_on_ground
+        const int32_t ground =
+            live & (type[i] != BLOCK_EMPTY) & (y[i] == drop_y[i]);
+        const int32_t moved = (move_ret[i] == 0) & live;
+
+        int32_t frames = left_frames[i] - ground;
+        int32_t fall = ground ? fps_counter[i] : last_fall[i];
+        frames = moved ? LOCK_DEFAULT_FRAMES : frames;
+        const int32_t moves = left_moves[i] - moved;
+        const int32_t lock = live & ((frames <= 0) | (ground & (moves <= 0)));
+        fall = lock ? -fall_after : fall;
+        score[i] = env_add_score(score[i], lock ? cell_amounts[type[i]] : 0);
+
+        left_frames[i] = frames;
+        left_moves[i] = moves;
+        last_fall[i] = fall;
+        falls[i] = live & (fps_counter[i] >= fall + fall_after);
+    }
+}
+
+/* Lock delay resets, stats_update and the end of the frame for every game
+ * that is still going, branch free again. */
+static void env_batch_end_frame(EnvBatch *const batch) {
+    const int n = batch->count;
+    const int32_t *restrict y = batch->block.y;
+    int32_t *restrict left_moves = batch->lock_piece_delay.left_moves;
+    int32_t *restrict left_frames = batch->lock_piece_delay.left_frames;
+    int32_t *restrict lowest = batch->lock_piece_delay.lowest;
+    int32_t *restrict rows = batch->stats.rows;
+    const int32_t *restrict combo = batch->stats.combo;
+    int32_t *restrict level = batch->stats.level;
+    int32_t *restrict score = batch->stats.score;
+    int32_t *restrict fps_counter = batch->fps_counter;
+    int32_t *restrict rows2add = batch->rows2add;
+    int32_t *restrict move_ret = batch->move_ret;
+    int32_t *restrict swap = batch->swap;
+    const int32_t *restrict over = batch->over;
+
+#pragma GCC ivdep
+    for (int i = 0; i < n; i++) {
+        const int32_t live = !over[i];
+        const int32_t reset = live & (lowest[i] < y[i]);
+        left_moves[i] = reset ? LOCK_DEFAULT_MOVES : left_moves[i];
+        left_frames[i] = reset ? LOCK_DEFAULT_FRAMES : left_frames[i];
+        lowest[i] = reset ? y[i] : lowest[i];
+
+        const int32_t cleared = live ? rows2add[i] : 0;
+        const int32_t points =
+            clear_points[cleared] + (cleared > 0) * 50 * combo[i];
+        rows[i] += cleared;
+        score[i] = env_add_score(score[i], (int64_t)points * level[i]);
+        level[i] = score[i] / 2500 + 1;
+
+        fps_counter[i] += live;
+        rows2add[i] = live ? 0 : rows2add[i];
+        swap[i] = live ? 0 : swap[i];
+        move_ret[i] = live ? -1 : move_ret[i];
+    }
+}
+
+/* Applies actions[i] to the game i and advances every game that isn't
+ * over by one frame, the same as engine_step with that one input. Returns
+ * how many games are still going. */
+int env_batch_step(EnvBatch *const batch, const Input *const actions) {
+    const int n = batch->count;
+
+    // The inputs branch on everything so it's one game at a time, most
+    // games don't press anything in a frame.
+    for (int i = 0; i < n; i++) {
+        if (actions[i] != INPUT_NONE && !batch->over[i])
+            env_input(batch, i, actions[i]);
+    }
+
+    env_batch_update_timers(batch);
+
+    // Gravity, spawning and the game over checks. The rows only change
+    // when a block is baked and a new one spawns right after, so the lock
+    // out check only has to be done then.
+    int running = 0;
+    for (int i = 0; i < n; i++) {
+        if (batch->over[i])
+            continue;
+        if (batch->falls[i]) {
+            batch->rows2add[i] += env_fall(batch, i);
+            batch->last_fall[i] = batch->fps_counter[i];
+        }
+        if (batch->block.type[i] == BLOCK_EMPTY || batch->swap[i]) {
+            const bool block_out = !env_spawn(batch, i);
+            const bool lock_out =
+                batch->rows[i * BOARD_HEIGHT + FIRST_TRUE_ROW-2] != 0;
+            batch->over[i] = block_out || lock_out;
+        }
+        running += !batch->over[i];
+    }
+
+    env_batch_end_frame(batch);
+    return running;
+}
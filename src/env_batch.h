@@ -0,0 +1,83 @@
+#ifndef ENV_BATCH_H
+#define ENV_BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "block.h"
+#include "engine.h"
+
+/* Many games stepped together, for things like training a player. The
+ * rules are the same as engine_step with one input per frame, so a game
+ * in a batch plays exactly like a BoardCtx with the same seed and inputs.
+ * Every field is an array with an element per game and the per frame
+ * logic is split into passes over those arrays: the ones that branch on
+ * the block (inputs, collisions, falling and spawning) go game by game,
+ * the timers and the stats are plain arithmetic the compiler can
+ * vectorise. Only the row masks are kept, there are no tile colors. */
+
+/* Block of every game, the same fields as Block. */
+typedef struct BlockArrays {
+    int32_t *x;
+    int32_t *y;
+    int32_t *rot;
+    int32_t *type;
+} BlockArrays;
+
+typedef struct LockPieceDelayArrays {
+    int32_t *left_moves;
+    int32_t *left_frames;
+    int32_t *lowest;
+} LockPieceDelayArrays;
+
+typedef struct StatsArrays {
+    int32_t *rows;
+    int32_t *blocks;
+    int32_t *combo;
+    int32_t *level;
+    int32_t *score;
+} StatsArrays;
+
+typedef struct EnvBatch {
+    int count;
+    // Every array below points into this single allocation, each one
+    // starts on its own cache line.
+    void *arena;
+
+    // rows[i*BOARD_HEIGHT + y] is the row y of the game i
+    uint16_t *rows;
+    BlockArrays block;
+    LockPieceDelayArrays lock_piece_delay;
+    StatsArrays stats;
+    int32_t *hold_type;
+    int32_t *hold_swapped;
+    // queue[i*STD_BUF_SIZE + k] comes k blocks after the current one
+    uint8_t *queue;
+    SevenBag *bags;
+
+    // the same as in GameCtx
+    int32_t *fps_counter;
+    int32_t *last_fall;
+    // only how many rows GameCtx.cleared has
+    int32_t *rows2add;
+    int32_t *move_ret;
+    int32_t *swap;
+    int32_t *to_swap;
+
+    // y the block would land on, it only changes when the block moves
+    // sideways, rotates or spawns so the ground check is a comparison
+    int32_t *drop_y;
+    // scratch for the passes of env_batch_step
+    int32_t *falls;
+
+    // games that are lost (or quit), they aren't stepped anymore
+    int32_t *over;
+} EnvBatch;
+
+EnvBatch *env_batch_create(const int count, const uint64_t seed);
+void env_batch_destroy(EnvBatch *const batch);
+void env_batch_reset(EnvBatch *const batch, const int i, const uint64_t seed);
+int env_batch_step(EnvBatch *const batch, const Input *const actions);
+const uint16_t *env_batch_get_rows(const EnvBatch *const batch, const int i);
+
+#endif
@@ -0,0 +1,193 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "evdev.h"
+#include "frame_clock.h"
+#include "input.h"
+
+#define EVDEV_READ_EVENTS 64
+#define BITS_PER_LONG (sizeof(unsigned long) * 8)
+
+static void *evdev_thread(void *arg);
+
+static bool evdev_test_bit(const unsigned long *const bits, const int bit) {
+    return bits[bit / BITS_PER_LONG] >> (bit % BITS_PER_LONG) & 1;
+}
+
+/* The same keys as in the terminal. */
+static Input evdev_code_to_input(const int code) {
+    switch (code) {
+    case KEY_C:
+        return INPUT_HOLD;
+    case KEY_LEFT:
+        return INPUT_LEFT;
+    case KEY_RIGHT:
+        return INPUT_RIGHT;
+    case KEY_DOWN:
+        return INPUT_SOFT_DROP;
+    case KEY_UP:
+    case KEY_X:
+        return INPUT_ROTATE_CW;
+    case KEY_Z:
+        return INPUT_ROTATE_CCW;
+    case KEY_A:
+        return INPUT_ROTATE_180;
+    case KEY_SPACE:
+        return INPUT_HARD_DROP;
+    case KEY_Q:
+        return INPUT_QUIT;
+    default:
+        return INPUT_NONE;
+    }
+}
+
+/* Returns an fd for path if it's a keyboard (it has letter keys) or -1. */
+static int evdev_open_keyboard(const char *const path) {
+    const int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    unsigned long keys[KEY_CNT / BITS_PER_LONG + 1] = { 0 };
+    if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) < 0 ||
+            !evdev_test_bit(keys, KEY_SPACE) ||
+            !evdev_test_bit(keys, KEY_Z)) {
+        close(fd);
+        return -1;
+    }
+    // the kernel timestamps the events on the game loop's clock
+    int clock = CLOCK_MONOTONIC;
+    if (ioctl(fd, EVIOCSCLOCKID, &clock) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Opens every keyboard in /dev/input and starts a thread reading them.
+ * Returns NULL when there's no keyboard that can be read. */
+Evdev *evdev_create(KeyQueue *const queue, const int wake_fd) {
+    DIR *dir = opendir("/dev/input");
+    if (dir == NULL)
+        return NULL;
+
+    Evdev *ret = calloc(1, sizeof(Evdev));
+    if (ret == NULL) {
+        fprintf(stderr, "Couldn't alloc evdev in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && ret->count < EVDEV_MAX_DEVICES) {
+        if (strncmp(entry->d_name, "event", strlen("event")) != 0)
+            continue;
+        char path[sizeof("/dev/input/") + sizeof(entry->d_name)];
+        snprintf(path, sizeof(path), "/dev/input/%s", entry->d_name);
+        const int fd = evdev_open_keyboard(path);
+        if (fd != -1)
+            ret->fds[ret->count++] = fd;
+    }
+    closedir(dir);
+    if (ret->count == 0) {
+        free(ret);
+        return NULL;
+    }
+
+    ret->queue = queue;
+    ret->wake_fd = wake_fd;
+    ret->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (ret->stop_fd == -1) {
+        perror("eventfd");
+        exit(EXIT_FAILURE);
+    }
+    if (pthread_create(&ret->thread, NULL, evdev_thread, ret)) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    return ret;
+}
+
+void evdev_destroy(Evdev *const evdev) {
+    const uint64_t one = 1;
+    if (write(evdev->stop_fd, &one, sizeof(one)) != sizeof(one)) {
+        perror("write");
+        exit(EXIT_FAILURE);
+    }
+    pthread_join(evdev->thread, NULL);
+    close(evdev->stop_fd);
+    for (int i = 0; i < evdev->count; i++)
+        close(evdev->fds[i]);
+    free(evdev);
+}
+
+/* Pushes the key events of the devices that have any, returns whether
+ * something was pushed. Autorepeat events are skipped, the game does its
+ * own repeating. */
+static bool evdev_read_events(Evdev *const evdev, struct pollfd *const fds) {
+    bool pushed = false;
+    for (int i = 0; i < evdev->count; i++) {
+        if (fds[i].revents & (POLLHUP | POLLERR)) {
+            // unplugged, poll ignores negative fds
+            fds[i].fd = -1;
+            continue;
+        }
+        if (!(fds[i].revents & POLLIN))
+            continue;
+
+        struct input_event events[EVDEV_READ_EVENTS];
+        const ssize_t len = read(fds[i].fd, events, sizeof(events));
+        if (len <= 0)
+            continue;
+        for (size_t j = 0; j < len / sizeof(struct input_event); j++) {
+            const struct input_event *event = &events[j];
+            if (event->type != EV_KEY || event->value == 2)
+                continue;
+            const KeyEvent key = {
+                .input = evdev_code_to_input(event->code),
+                .pressed = event->value == 1,
+                .time_ns = event->input_event_sec * NSEC_PER_SEC +
+                    event->input_event_usec * 1000ll
+            };
+            if (key.input != INPUT_NONE)
+                pushed |= key_queue_push(evdev->queue, &key);
+        }
+    }
+    return pushed;
+}
+
+static void *evdev_thread(void *arg) {
+    Evdev *evdev = arg;
+    struct pollfd fds[EVDEV_MAX_DEVICES + 1];
+    for (int i = 0; i < evdev->count; i++)
+        fds[i] = (struct pollfd){ .fd = evdev->fds[i], .events = POLLIN };
+    fds[evdev->count] = (struct pollfd){ .fd = evdev->stop_fd, .events = POLLIN };
+
+    for (;;) {
+        if (poll(fds, evdev->count + 1, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+        if (fds[evdev->count].revents & POLLIN)
+            break;
+        if (evdev_read_events(evdev, fds)) {
+            const uint64_t one = 1;
+            if (write(evdev->wake_fd, &one, sizeof(one)) != sizeof(one)) {
+                // the counter is full which also wakes the loop
+            }
+        }
+    }
+    return NULL;
+}
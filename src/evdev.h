@@ -0,0 +1,27 @@
+#ifndef EVDEV_H
+#define EVDEV_H
+
+#include <pthread.h>
+
+#include "input.h"
+
+/* Kept away from input.c because linux/input.h and curses both define
+ * KEY_LEFT and friends. */
+
+#define EVDEV_MAX_DEVICES 16
+
+typedef struct Evdev {
+    int fds[EVDEV_MAX_DEVICES];
+    int count;
+    // the thread stops when this eventfd is written to
+    int stop_fd;
+    // and this one is written to after every batch of events
+    int wake_fd;
+    KeyQueue *queue;
+    pthread_t thread;
+} Evdev;
+
+Evdev *evdev_create(KeyQueue *const queue, const int wake_fd);
+void evdev_destroy(Evdev *const evdev);
+
+#endif
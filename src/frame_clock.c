@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frame_clock.h"
+
+static long long timespec_to_ns(const struct timespec *const ts) {
+    return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static struct timespec ns_to_timespec(const long long ns) {
+    return (struct timespec) {
+        .tv_sec = ns / NSEC_PER_SEC,
+        .tv_nsec = ns % NSEC_PER_SEC
+    };
+}
+
+/* CLOCK_MONOTONIC in nanoseconds. The ticks are scheduled on it and
+ * everything else that measures time (key timestamps, frame timings,
+ * timeouts) uses it too so the times can be compared. */
+long long frame_clock_get_time_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_to_ns(&now);
+}
+
+/* The first tick is due right away. */
+void frame_clock_init(FrameClock *const clock, const int hz) {
+    clock->period_ns = NSEC_PER_SEC / hz;
+    clock->next = ns_to_timespec(frame_clock_get_time_ns());
+    clock->dropped = 0;
+    clock->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (clock->timer_fd == -1) {
+        perror("timerfd_create");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void frame_clock_uninit(FrameClock *const clock) {
+    close(clock->timer_fd);
+}
+
+/* Returns how many ticks are due now and moves the schedule past them, 0
+ * when the next tick isn't due yet. */
+int frame_clock_get_due(FrameClock *const clock) {
+    const long long now = frame_clock_get_time_ns();
+    const long long late = now - timespec_to_ns(&clock->next);
+    if (late < 0)
+        return 0;
+
+    long long ticks = late / clock->period_ns + 1;
+    long long next = timespec_to_ns(&clock->next) + ticks * clock->period_ns;
+    if (ticks > FRAME_CLOCK_MAX_CATCH_UP) {
+        // too far behind, start the schedule over from now
+        clock->dropped += ticks - FRAME_CLOCK_MAX_CATCH_UP;
+        ticks = FRAME_CLOCK_MAX_CATCH_UP;
+        next = now + clock->period_ns;
+    }
+    clock->next = ns_to_timespec(next);
+    return ticks;
+}
+
+/* Blocks until the next tick is due or fd (stdin usually) has something
+ * to read, whichever comes first. Returns how many ticks to run, more than
+ * one when the caller fell behind and 0 when only fd woke it up. A
+ * negative fd only waits for the tick. */
+int frame_clock_wait(FrameClock *const clock, const int fd) {
+    for (;;) {
+        const int ticks = frame_clock_get_due(clock);
+        if (ticks > 0)
+            return ticks;
+
+        // one shot at the absolute time of the tick so a wakeup by fd
+        // doesn't push it back
+        const struct itimerspec timer = { .it_value = clock->next };
+        timerfd_settime(clock->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+        struct pollfd fds[] = {
+            { .fd = fd, .events = POLLIN },
+            { .fd = clock->timer_fd, .events = POLLIN }
+        };
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(EXIT_FAILURE);
+        }
+        // The timer doesn't have to be read, arming it again clears the
+        // expiration. The tick is checked at the top.
+        if (fds[0].revents)
+            return frame_clock_get_due(clock);
+    }
+}
+
+/* When the i-th of the ticks the last frame_clock_wait returned was due.
+ * After falling too far behind they're put right before now. */
+long long frame_clock_get_tick_ns(
+        const FrameClock *const clock,
+        const int ticks,
+        const int i) {
+    return timespec_to_ns(&clock->next) - (ticks - i) * clock->period_ns;
+}
@@ -0,0 +1,38 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <time.h>
+
+/* After a stall (the terminal was suspended, the machine was loaded) at
+ * most this many logic ticks are run to catch up, the rest are dropped so
+ * the game doesn't fast forward. */
+#define FRAME_CLOCK_MAX_CATCH_UP 5
+
+#define NSEC_PER_SEC 1000000000ll
+
+/* Schedules logic ticks at a fixed rate on the monotonic clock. Ticks are
+ * due at start + n*period no matter how long a frame took, so the rate
+ * doesn't drift like sleeping a frame after the work does. Waiting is a
+ * poll on a timerfd armed for the next tick together with an input fd, so
+ * the caller wakes up as soon as a key is pressed and not at the next
+ * tick. */
+typedef struct FrameClock {
+    long long period_ns;
+    // when the next tick is due, CLOCK_MONOTONIC
+    struct timespec next;
+    // ticks dropped after stalls so far
+    long long dropped;
+    int timer_fd;
+} FrameClock;
+
+long long frame_clock_get_time_ns(void);
+void frame_clock_init(FrameClock *const clock, const int hz);
+void frame_clock_uninit(FrameClock *const clock);
+int frame_clock_get_due(FrameClock *const clock);
+int frame_clock_wait(FrameClock *const clock, const int fd);
+long long frame_clock_get_tick_ns(
+        const FrameClock *const clock,
+        const int ticks,
+        const int i);
+
+#endif
@@ -0,0 +1,278 @@
+#include <ncurses.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "engine.h"
+#include "evdev.h"
+#include "frame_clock.h"
+#include "input.h"
+
+void key_queue_init(KeyQueue *const queue) {
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+}
+
+/* Only the producer calls this. Returns false and drops the event when
+ * the queue is full. */
+bool key_queue_push(KeyQueue *const queue, const KeyEvent *const event) {
+    const size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    const size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head - tail == KEY_QUEUE_SIZE)
+        return false;
+    queue->events[head % KEY_QUEUE_SIZE] = *event;
+    // the event has to be written before the consumer can see the new head
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+/* Only the consumer calls this. Returns false when the queue is empty. */
+bool key_queue_pop(KeyQueue *const queue, KeyEvent *const event) {
+    const size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    const size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail == head)
+        return false;
+    *event = queue->events[tail % KEY_QUEUE_SIZE];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+static Input input_terminal_key(const int key) {
+    switch (key) {
+    case 'c':
+    case 'C':
+        return INPUT_HOLD;
+    case KEY_LEFT:
+        return INPUT_LEFT;
+    case KEY_RIGHT:
+        return INPUT_RIGHT;
+    case KEY_DOWN:
+        return INPUT_SOFT_DROP;
+    case KEY_UP:
+    case 'x':
+    case 'X':
+        return INPUT_ROTATE_CW;
+    case 'z':
+    case 'Z':
+        return INPUT_ROTATE_CCW;
+    case 'a':
+    case 'A':
+        return INPUT_ROTATE_180;
+    case ' ':
+        return INPUT_HARD_DROP;
+    case 'q':
+    case 'Q':
+        return INPUT_QUIT;
+    default:
+        return INPUT_NONE;
+    }
+}
+
+/* Falls back to the terminal when no keyboard device can be read, usually
+ * because the user isn't in the input group. kitty_keyboard is whether the
+ * terminal said it speaks the kitty protocol, see terminal_query. */
+InputCtx *input_create(const InputBackend backend, const bool kitty_keyboard) {
+    InputCtx *ret = aligned_alloc(CACHE_LINE_SIZE, sizeof(InputCtx));
+    if (ret == NULL) {
+        fprintf(stderr, "Couldn't alloc input ctx in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    ret->backend = INPUT_BACKEND_TERMINAL;
+    ret->fd = STDIN_FILENO;
+    ret->evdev = NULL;
+    ret->seq_len = 0;
+    key_queue_init(&ret->queue);
+
+    if (backend == INPUT_BACKEND_EVDEV) {
+        const int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd == -1) {
+            perror("eventfd");
+            exit(EXIT_FAILURE);
+        }
+        ret->evdev = evdev_create(&ret->queue, wake_fd);
+        if (ret->evdev == NULL) {
+            close(wake_fd);
+            debug("can't read a keyboard in /dev/input, using the terminal");
+        } else {
+            ret->backend = INPUT_BACKEND_EVDEV;
+            ret->fd = wake_fd;
+            debug("reading %d keyboard device(s)", ret->evdev->count);
+        }
+    }
+    if (ret->backend == INPUT_BACKEND_TERMINAL && kitty_keyboard) {
+        ret->backend = INPUT_BACKEND_KITTY;
+        debug("the terminal reports key releases");
+    }
+    return ret;
+}
+
+void input_destroy(InputCtx *const input) {
+    if (input->evdev != NULL) {
+        evdev_destroy(input->evdev);
+        close(input->fd);
+    }
+    free(input);
+}
+
+/* Switches the terminal to the kitty protocol while a game runs, the menus
+ * keep using curses' own key decoding. The evdev thread reads the keys
+ * the whole time, the ones from the menus are thrown away so they don't
+ * end up in the game. Nothing to do for the terminal. */
+void input_begin(InputCtx *const input) {
+    // flags 11: disambiguate escape codes (1), report key releases (2) and
+    // report every key as an escape code (8), without 8 plain letters have
+    // no releases
+    static const char push[] = "\033[>11u";
+    if (input->backend == INPUT_BACKEND_EVDEV) {
+        // the same order as in input_poll
+        uint64_t count;
+        const ssize_t ret = read(input->fd, &count, sizeof(count));
+        (void)ret;
+        KeyEvent event;
+        while (key_queue_pop(&input->queue, &event))
+            ;
+        return;
+    }
+    if (input->backend != INPUT_BACKEND_KITTY)
+        return;
+    keypad(stdscr, FALSE);
+    input->seq_len = 0;
+    if (write(STDOUT_FILENO, push, strlen(push)) != (ssize_t)strlen(push))
+        debug("couldn't enable the kitty protocol");
+}
+
+void input_end(InputCtx *const input) {
+    static const char pop[] = "\033[<u";
+    if (input->backend != INPUT_BACKEND_KITTY)
+        return;
+    if (write(STDOUT_FILENO, pop, strlen(pop)) != (ssize_t)strlen(pop))
+        debug("couldn't disable the kitty protocol");
+    keypad(stdscr, TRUE);
+}
+
+/* Key of a complete kitty sequence (without the "\033["), final is its
+ * last character. Arrows keep their legacy letters, everything else is
+ * "code;modifiers:event u" where the code is the unshifted key. */
+static Input input_kitty_key(const int code, const char final) {
+    switch (final) {
+    case 'A':
+        return INPUT_ROTATE_CW;
+    case 'B':
+        return INPUT_SOFT_DROP;
+    case 'C':
+        return INPUT_RIGHT;
+    case 'D':
+        return INPUT_LEFT;
+    case 'u':
+        return code < 128 ? input_terminal_key(code) : INPUT_NONE;
+    default:
+        return INPUT_NONE;
+    }
+}
+
+/* Parses the sequence in input->seq, returns how many events it made. */
+static size_t input_kitty_sequence(InputCtx *const input, KeyEvent *const events) {
+    const char final = input->seq[input->seq_len - 1];
+    input->seq[input->seq_len - 1] = '\0';
+    const char *params = input->seq + strlen("\033[");
+    // answers to queries start with ? or >, not keys
+    if (!(*params == '\0' || *params == ';' || (*params >= '0' && *params <= '9')))
+        return 0;
+
+    char *end;
+    long code = strtol(params, &end, 10);
+    if (end == params)
+        code = 1;
+    // alternate keys, only there with other flags
+    end += strcspn(end, ";");
+    long modifiers = 1;
+    long event = 1;
+    if (*end == ';') {
+        modifiers = strtol(end + 1, &end, 10);
+        if (*end == ':')
+            event = strtol(end + 1, &end, 10);
+    }
+
+    // ctrl+c comes as a key too, keep it quitting the program
+    if (final == 'u' && code == 'c' && (modifiers - 1) & 4)
+        raise(SIGINT);
+    const Input key = input_kitty_key(code, final);
+    // the engine does its own repeating (event 2)
+    if (key == INPUT_NONE || event == 2)
+        return 0;
+    events[0] = (KeyEvent){ key, event != 3, frame_clock_get_time_ns() };
+    return 1;
+}
+
+/* Feeds a byte from the terminal to the kitty parser, returns how many
+ * events came out of it. Anything outside of an escape sequence is an
+ * ordinary typed key. */
+static size_t input_kitty_byte(InputCtx *const input, const int byte, KeyEvent *const events) {
+    if (input->seq_len == 1 && byte != '[')
+        input->seq_len = 0;
+    if (input->seq_len == 0) {
+        if (byte == '\033') {
+            input->seq[input->seq_len++] = byte;
+            return 0;
+        }
+        const Input key = input_terminal_key(byte);
+        if (key == INPUT_NONE)
+            return 0;
+        const long long now = frame_clock_get_time_ns();
+        events[0] = (KeyEvent){ key, true, now };
+        events[1] = (KeyEvent){ key, false, now };
+        return 2;
+    }
+
+    if (input->seq_len == INPUT_MAX_SEQ - 1) {
+        input->seq_len = 0;
+        return 0;
+    }
+    input->seq[input->seq_len++] = byte;
+    if (input->seq_len <= 2 || byte < 0x40 || byte > 0x7e)
+        return 0;
+    const size_t n = input_kitty_sequence(input, events);
+    input->seq_len = 0;
+    return n;
+}
+
+/* Fills events with the key events since the last call, oldest first, and
+ * returns how many there are. */
+size_t input_poll(InputCtx *const input, KeyEvent *const events, const size_t max) {
+    size_t n = 0;
+    if (input->backend == INPUT_BACKEND_KITTY) {
+        int byte;
+        while (n + 2 <= max && (byte = getch()) != ERR)
+            n += input_kitty_byte(input, byte, &events[n]);
+        return n;
+    }
+    if (input->backend == INPUT_BACKEND_TERMINAL) {
+        int key;
+        while (n + 2 <= max && (key = getch()) != ERR) {
+            const Input pressed = input_terminal_key(key);
+            if (pressed == INPUT_NONE)
+                continue;
+            const long long now = frame_clock_get_time_ns();
+            events[n++] = (KeyEvent){ pressed, true, now };
+            events[n++] = (KeyEvent){ pressed, false, now };
+        }
+        return n;
+    }
+
+    // The terminal gets the keys too, nobody reads them.
+    while (getch() != ERR)
+        ;
+    // Clear the eventfd before popping, events pushed after this write to
+    // it again so the loop can't sleep through them.
+    uint64_t count;
+    const ssize_t ret = read(input->fd, &count, sizeof(count));
+    (void)ret;
+    while (n < max && key_queue_pop(&input->queue, &events[n]))
+        n++;
+    return n;
+}
@@ -0,0 +1,69 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "engine.h"
+
+/* Where the keys come from. A plain terminal only tells when a key was
+ * typed (and repeats it at the terminal's autorepeat rate). Terminals that
+ * speak the kitty keyboard protocol (CSI u) also report keys going up,
+ * that works over ssh too. evdev reads the keyboard device itself. */
+
+#define KEY_QUEUE_SIZE 256
+#define INPUT_MAX_EVENTS 64
+// longest escape sequence the kitty parser keeps, longer ones are dropped
+#define INPUT_MAX_SEQ 32
+
+typedef enum InputBackend {
+    INPUT_BACKEND_TERMINAL,
+    INPUT_BACKEND_KITTY,
+    INPUT_BACKEND_EVDEV
+} InputBackend;
+
+/* A key going down or up. The terminal backend can't tell when a key goes
+ * up so every key typed there is a press and a release at the same time. */
+typedef struct KeyEvent {
+    Input input;
+    bool pressed;
+    // CLOCK_MONOTONIC, the game applies the key before the first tick due
+    // after it
+    long long time_ns;
+} KeyEvent;
+
+/* Lock-free queue with one thread pushing and one popping. head and tail
+ * only ever grow and are on their own cache lines so the two threads
+ * don't fight over them. */
+typedef struct KeyQueue {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t head;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;
+    _Alignas(CACHE_LINE_SIZE) KeyEvent events[KEY_QUEUE_SIZE];
+} KeyQueue;
+
+struct Evdev;
+
+typedef struct InputCtx {
+    InputBackend backend;
+    // what the game loop should poll, stdin or an eventfd the evdev thread
+    // writes to after pushing events
+    int fd;
+    KeyQueue queue;
+    struct Evdev *evdev;
+    // the part of a kitty escape sequence read so far
+    char seq[INPUT_MAX_SEQ];
+    int seq_len;
+} InputCtx;
+
+void key_queue_init(KeyQueue *const queue);
+bool key_queue_push(KeyQueue *const queue, const KeyEvent *const event);
+bool key_queue_pop(KeyQueue *const queue, KeyEvent *const event);
+
+InputCtx *input_create(const InputBackend backend, const bool kitty_keyboard);
+void input_destroy(InputCtx *const input);
+void input_begin(InputCtx *const input);
+void input_end(InputCtx *const input);
+size_t input_poll(InputCtx *const input, KeyEvent *const events, const size_t max);
+
+#endif
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "block.h"
+#include "board.h"
+#include "engine.h"
+#include "movegen.h"
+
+// canonical_rots[type][rot] is the first rotation with the same shape as
+// rot, e.g. O is the same in every rotation and I, S, Z in UP and DOWN.
+// Two placements cover the same cells if their canonical rotations and the
+// top left corners of their tiles match.
+static Rotation canonical_rots[BLOCK_MAX][ROTATION_MAX];
+
+static bool piece_mask_same_shape(
+        const PieceMask *const a,
+        const PieceMask *const b) {
+    if (a->max_x - a->min_x != b->max_x - b->min_x ||
+            a->max_y - a->min_y != b->max_y - b->min_y)
+        return false;
+    for (int y = 0; y <= a->max_y - a->min_y; y++) {
+        if (a->rows[a->min_y + y] >> a->min_x !=
+                b->rows[b->min_y + y] >> b->min_x)
+            return false;
+    }
+    return true;
+}
+
+__attribute__((constructor))
+static void movegen_generate_canonical_rots(void) {
+    for (BlockType type = BLOCK_EMPTY; type < BLOCK_MAX; type++) {
+        for (Rotation rot = UP; rot < ROTATION_MAX; rot++) {
+            canonical_rots[type][rot] = rot;
+            for (Rotation prev = UP; prev < rot; prev++) {
+                if (piece_mask_same_shape(
+                            block_get_mask(type, prev),
+                            block_get_mask(type, rot))) {
+                    canonical_rots[type][rot] = prev;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+MoveGen *movegen_create(void) {
+    MoveGen *ret = malloc(sizeof(MoveGen));
+    if (ret == NULL) {
+        fprintf(
+                stderr,
+                "Couldn't alloc a move generator in function %s.\n",
+                __func__);
+        exit(EXIT_FAILURE);
+    }
+    ret->placements_used = 0;
+    return ret;
+}
+
+void movegen_destroy(MoveGen *const gen) {
+    free(gen);
+}
+
+/* Board row y as seen by a block at x + MOVEGEN_PAD, the walls and
+ * anything above or below the board count as filled tiles. */
+static uint32_t movegen_padded_row(const Board *const board, const int y) {
+    if (y < 0 || y >= board->height)
+        return UINT32_MAX;
+    return (uint32_t)board->rows[y] << MOVEGEN_PAD |
+        ((1u << MOVEGEN_PAD) - 1) |
+        UINT32_MAX << (board->width + MOVEGEN_PAD);
+}
+
+/* The same test as block_can_move but for every x of a (rot, y) pair at
+ * once, so the searches never have to look at the board again. A block
+ * collides at x when one of its tiles at b lands on a filled tile, so
+ * or-ing the padded rows shifted right by every b gives all the colliding
+ * x. */
+static void movegen_generate_fits(
+        MoveGen *const gen,
+        const Board *const board,
+        const BlockType type) {
+    const uint32_t inside = (1u << (board->width + MOVEGEN_PAD)) - 1;
+    for (Rotation rot = UP; rot < ROTATION_MAX; rot++) {
+        const PieceMask *mask = block_get_mask(type, rot);
+        for (int y = -MOVEGEN_PAD; y < board->height; y++) {
+            uint32_t collides = 0;
+            for (int tile_y = mask->min_y; tile_y <= mask->max_y; tile_y++) {
+                const uint32_t row = movegen_padded_row(board, y + tile_y);
+                for (uint16_t bits = mask->rows[tile_y]; bits; bits &= bits - 1)
+                    collides |= row >> __builtin_ctz(bits);
+            }
+            gen->fits[rot][y + MOVEGEN_PAD] = ~collides & inside;
+        }
+    }
+}
+
+static bool movegen_fits(
+        const MoveGen *const gen,
+        const Board *const board,
+        const int x,
+        const int y,
+        const Rotation rot) {
+    if (x < -MOVEGEN_PAD || x >= board->width ||
+            y < -MOVEGEN_PAD || y >= board->height)
+        return false;
+    return gen->fits[rot][y + MOVEGEN_PAD] >> (x + MOVEGEN_PAD) & 1;
+}
+
+static uint32_t shift_x(const uint32_t bits, const int x) {
+    return x >= 0 ? bits << x : bits >> -x;
+}
+
+/* Every position reachable from bits by moving left or right. */
+static uint32_t movegen_flood(uint32_t bits, const uint32_t fits) {
+    uint32_t prev;
+    do {
+        prev = bits;
+        bits |= (bits << 1 | bits >> 1) & fits;
+    } while (bits != prev);
+    return bits;
+}
+
+/* Same as block_rotate but for a whole row of positions. Every kick only
+ * gets the positions where all the kicks before it failed. */
+static void movegen_rotate_row(
+        MoveGen *const gen,
+        const Board *const board,
+        const BlockType type,
+        const Rotation from,
+        const Rotation to,
+        const int row,
+        uint32_t bits) {
+    const Wallkick *kick = block_get_wallkick(type, from, to);
+    for (int i = 0; i < kick->tests && bits; i++) {
+        const int kicked_row = row + kick->moves[i].y;
+        if (kicked_row < 0 || kicked_row >= board->height + MOVEGEN_PAD)
+            continue;
+        const uint32_t moved =
+            shift_x(bits, kick->moves[i].x) & gen->fits[to][kicked_row];
+        gen->reached[to][kicked_row] |= moved;
+        bits &= ~shift_x(moved, -kick->moves[i].x);
+    }
+}
+
+static void movegen_add_placement(MoveGen *const gen, const Block *const block) {
+    const PieceMask *mask = block_get_mask(block->type, block->rot);
+    uint32_t *placed = &gen->placed
+        [canonical_rots[block->type][block->rot]][block->y + mask->min_y];
+    const uint32_t bit = 1u << (block->x + mask->min_x);
+    if (*placed & bit)
+        return;
+    *placed |= bit;
+    gen->placements[gen->placements_used++] = *block;
+}
+
+/* Generates the placements of a block of the given type spawned the same
+ * way engine_logic does it. Returns the amount of placements, which are
+ * in gen->placements. */
+size_t movegen_generate(
+        MoveGen *const gen,
+        const Board *const board,
+        const BlockType type) {
+    Block start = { SPAWN_X, SPAWN_Y, UP, type };
+    if (!block_find_spawn(&start, board)) {
+        gen->placements_used = 0;
+        return 0;
+    }
+    return movegen_generate_from(gen, board, &start);
+}
+
+/* Same as movegen_generate but starts from any block already on the
+ * board. */
+size_t movegen_generate_from(
+        MoveGen *const gen,
+        const Board *const board,
+        const Block *const start) {
+    const BlockType type = start->type;
+    const int rows = board->height + MOVEGEN_PAD;
+    gen->placements_used = 0;
+    if (type == BLOCK_EMPTY)
+        return 0;
+
+    movegen_generate_fits(gen, board, type);
+    if (!movegen_fits(gen, board, start->x, start->y, start->rot))
+        return 0;
+    memset(gen->reached, 0, sizeof(gen->reached));
+    memset(gen->expanded, 0, sizeof(gen->expanded));
+    memset(gen->placed, 0, sizeof(gen->placed));
+    gen->reached[start->rot][start->y + MOVEGEN_PAD] =
+        1u << (start->x + MOVEGEN_PAD);
+
+    // Going top to bottom soft drops are handled in the same pass, only
+    // rotations into rows that were already passed need another one.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Rotation rot = UP; rot < ROTATION_MAX; rot++) {
+            for (int row = 0; row < rows; row++) {
+                if (!(gen->reached[rot][row] & ~gen->expanded[rot][row]))
+                    continue;
+                const uint32_t reached =
+                    movegen_flood(gen->reached[rot][row], gen->fits[rot][row]);
+                const uint32_t new = reached & ~gen->expanded[rot][row];
+                gen->reached[rot][row] = reached;
+                gen->expanded[rot][row] = reached;
+                changed = true;
+
+                if (row + 1 < rows)
+                    gen->reached[rot][row + 1] |= new & gen->fits[rot][row + 1];
+                for (int turn = 1; turn < ROTATION_MAX; turn++) {
+                    movegen_rotate_row(
+                            gen,
+                            board,
+                            type,
+                            rot,
+                            (rot + turn) % ROTATION_MAX,
+                            row,
+                            new);
+                }
+            }
+        }
+    }
+
+    // a block rests where it can't be moved down
+    for (Rotation rot = UP; rot < ROTATION_MAX; rot++) {
+        for (int row = 0; row < rows; row++) {
+            uint32_t resting = gen->reached[rot][row];
+            if (row + 1 < rows)
+                resting &= ~gen->fits[rot][row + 1];
+            for (; resting; resting &= resting - 1) {
+                const Block block = {
+                    .x = __builtin_ctz(resting) - MOVEGEN_PAD,
+                    .y = row - MOVEGEN_PAD,
+                    .rot = rot,
+                    .type = type
+                };
+                movegen_add_placement(gen, &block);
+            }
+        }
+    }
+    return gen->placements_used;
+}
+
+/* Same as block_rotate but on a single search state. Returns false when
+ * none of the kicks fit. */
+static bool movegen_rotate(
+        const MoveGen *const gen,
+        const Board *const board,
+        Block *const block,
+        const Rotation to) {
+    const Wallkick *kick = block_get_wallkick(block->type, block->rot, to);
+    for (int i = 0; i < kick->tests; i++) {
+        const int x = block->x + kick->moves[i].x;
+        const int y = block->y + kick->moves[i].y;
+        if (movegen_fits(gen, board, x, y, to)) {
+            *block = (Block){ x, y, to, block->type };
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t movegen_push(
+        MoveGen *const gen,
+        size_t used,
+        const Block *const block,
+        const Input input,
+        const uint16_t parent) {
+    uint32_t *visited = &gen->expanded[block->rot][block->y + MOVEGEN_PAD];
+    const uint32_t bit = 1u << (block->x + MOVEGEN_PAD);
+    if (*visited & bit)
+        return used;
+    *visited |= bit;
+    gen->nodes[used] = (MoveGenNode){
+        .x = block->x,
+        .y = block->y,
+        .rot = block->rot,
+        .input = input,
+        .parent = parent
+    };
+    return used + 1;
+}
+
+/* Finds the shortest sequence of inputs that moves start to target with a
+ * BFS over single positions. It's a lot slower than movegen_generate so
+ * it's meant for the one placement that's actually played. Writes at most
+ * max inputs and returns the length of the whole path like snprintf does,
+ * or -1 when target can't be reached. The block still has to be hard
+ * dropped (or left to lock) after that. */
+int movegen_find_path(
+        MoveGen *const gen,
+        const Board *const board,
+        const Block *const start,
+        const Block *const target,
+        Input *const inputs,
+        const size_t max) {
+    const BlockType type = start->type;
+    if (type == BLOCK_EMPTY)
+        return -1;
+    movegen_generate_fits(gen, board, type);
+    if (!movegen_fits(gen, board, start->x, start->y, start->rot))
+        return -1;
+    memset(gen->expanded, 0, sizeof(gen->expanded));
+
+    size_t used = movegen_push(gen, 0, start, INPUT_NONE, MOVEGEN_NO_PARENT);
+    // the nodes array is the queue, everything before head is done
+    for (size_t head = 0; head < used; head++) {
+        const MoveGenNode node = gen->nodes[head];
+        const Block block = { node.x, node.y, node.rot, type };
+        if (block.x == target->x && block.y == target->y &&
+                block.rot == target->rot) {
+            int len = 0;
+            for (size_t i = head; gen->nodes[i].parent != MOVEGEN_NO_PARENT;
+                    i = gen->nodes[i].parent)
+                len++;
+            int i = len;
+            for (size_t n = head; gen->nodes[n].parent != MOVEGEN_NO_PARENT;
+                    n = gen->nodes[n].parent) {
+                i--;
+                if ((size_t)i < max)
+                    inputs[i] = gen->nodes[n].input;
+            }
+            return len;
+        }
+
+        static const struct {
+            Input input;
+            int x;
+            int y;
+        } moves[] = {
+            { INPUT_LEFT, -1, 0 },
+            { INPUT_RIGHT, 1, 0 },
+            { INPUT_SOFT_DROP, 0, 1 }
+        };
+        for (size_t i = 0; i < sizeof(moves)/sizeof(moves[0]); i++) {
+            const Block moved = {
+                block.x + moves[i].x,
+                block.y + moves[i].y,
+                block.rot,
+                type
+            };
+            if (movegen_fits(gen, board, moved.x, moved.y, moved.rot))
+                used = movegen_push(gen, used, &moved, moves[i].input, head);
+        }
+
+        static const struct {
+            Input input;
+            int turn;
+        } rotations[] = {
+            { INPUT_ROTATE_CW, 1 },
+            { INPUT_ROTATE_CCW, ROTATION_MAX - 1 },
+            { INPUT_ROTATE_180, 2 }
+        };
+        for (size_t i = 0; i < sizeof(rotations)/sizeof(rotations[0]); i++) {
+            Block rotated = block;
+            if (movegen_rotate(
+                        gen,
+                        board,
+                        &rotated,
+                        (block.rot + rotations[i].turn) % ROTATION_MAX))
+                used = movegen_push(gen, used, &rotated, rotations[i].input, head);
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,68 @@
+#ifndef MOVEGEN_H
+#define MOVEGEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block.h"
+#include "board.h"
+#include "engine.h"
+
+/* Placement generator. Finds every spot a block can be locked in by a
+ * player pressing left, right, soft drop and the rotation keys, kicks
+ * included, so T-spin and other kick-in slots are found too.
+ * The search is over (x, y, rot) but it's done a whole row of x at a time:
+ * every (rot, y) pair has a bitset of x. Blocks can stick out of the board
+ * by up to 3 tiles on the top and left so x and y are padded by that much,
+ * bit x + MOVEGEN_PAD of a row is the position x. */
+#define MOVEGEN_PAD 3
+#define MOVEGEN_ROWS (BOARD_MAX_HEIGHT + MOVEGEN_PAD)
+#define MOVEGEN_MAX_STATES \
+    (ROTATION_MAX * (BOARD_MAX_WIDTH + MOVEGEN_PAD) * MOVEGEN_ROWS)
+#define MOVEGEN_NO_PARENT UINT16_MAX
+
+/* One state of the path search and the input that led to it from its
+ * parent. */
+typedef struct MoveGenNode {
+    int8_t x;
+    int8_t y;
+    uint8_t rot;
+    uint8_t input;
+    uint16_t parent;
+} MoveGenNode;
+
+typedef struct MoveGen {
+    size_t placements_used;
+    // fits[rot][y] has the bit x set when the block fits at x, y, rot
+    uint32_t fits[ROTATION_MAX][MOVEGEN_ROWS];
+    // positions the block can be moved to
+    uint32_t reached[ROTATION_MAX][MOVEGEN_ROWS];
+    // reached positions whose neighbours were already looked at
+    uint32_t expanded[ROTATION_MAX][MOVEGEN_ROWS];
+    // placements already found, indexed by the top left corner of their
+    // tiles and the first rotation with the same shape
+    uint32_t placed[ROTATION_MAX][BOARD_MAX_HEIGHT];
+    Block placements[MOVEGEN_MAX_STATES];
+    // only used by movegen_find_path
+    MoveGenNode nodes[MOVEGEN_MAX_STATES];
+} MoveGen;
+
+MoveGen *movegen_create(void);
+void movegen_destroy(MoveGen *const gen);
+size_t movegen_generate(
+        MoveGen *const gen,
+        const Board *const board,
+        const BlockType type);
+size_t movegen_generate_from(
+        MoveGen *const gen,
+        const Board *const board,
+        const Block *const start);
+int movegen_find_path(
+        MoveGen *const gen,
+        const Board *const board,
+        const Block *const start,
+        const Block *const target,
+        Input *const inputs,
+        const size_t max);
+
+#endif
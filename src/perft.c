@@ -0,0 +1,474 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "block.h"
+#include "board.h"
+#include "circular_buffer.h"
+#include "engine.h"
+#include "movegen.h"
+#include "transposition.h"
+
+/* Like chess perft. Starting from a board and the queue of a seeded game it
+ * places blocks in every possible way depth times and counts the
+ * placement sequences and the distinct boards at the end. The counts never
+ * change unless the rules do so they're checked against the table below,
+ * and the time it takes is a benchmark of the whole movegen/bake/clear
+ * path.
+ * The placements of the first block are split between threads. The same
+ * board, hold and queue position with the same depth left always give the
+ * same counts so those are stored in a transposition table shared by all
+ * threads, a thread that gets there later only adds the stored amount of
+ * sequences. Its boards were already added to the set of the thread that
+ * searched it and the sets are merged at the end. */
+
+#define PERFT_MAX_DEPTH 16
+
+#define ARRAY_SIZE(arr) (sizeof((arr)) / sizeof((arr)[0]))
+
+typedef struct Position {
+    const char *name;
+    // bottom rows of the board, # is a filled tile
+    const char *rows[8];
+} Position;
+
+static const Position positions[] = {
+    { "empty", { NULL } },
+    {
+        // T-spin double slot, and some overhangs to tuck under
+        "tsd",
+        {
+            "##...#####",
+            "###.######",
+            "##..######",
+            "####.#####",
+            NULL
+        }
+    },
+};
+
+typedef struct Expected {
+    int position;
+    uint64_t seed;
+    bool hold;
+    int depth;
+    uint64_t sequences;
+    uint64_t boards;
+} Expected;
+
+// position, seed, hold, depth, sequences, boards
+static const Expected expected[] = {
+    { 0, 0, false, 1, 17, 17 },
+    { 0, 0, false, 2, 578, 578 },
+    { 0, 0, false, 3, 10163, 10163 },
+    { 0, 0, false, 4, 371702, 370420 },
+    { 0, 0, true, 1, 51, 51 },
+    { 0, 0, true, 2, 2047, 1668 },
+    { 0, 0, true, 3, 114014, 80570 },
+    { 0, 0, true, 4, 5137463, 2705703 },
+    { 0, 1, false, 1, 17, 17 },
+    { 0, 1, false, 2, 153, 153 },
+    { 0, 1, false, 3, 5376, 5376 },
+    { 0, 1, false, 4, 96441, 96441 },
+    { 0, 1, true, 1, 26, 26 },
+    { 0, 1, true, 2, 1203, 1097 },
+    { 0, 1, true, 3, 42958, 30455 },
+    { 0, 1, true, 4, 2338029, 1407828 },
+    { 1, 0, false, 1, 17, 17 },
+    { 1, 0, false, 2, 581, 581 },
+    { 1, 0, false, 3, 10308, 10308 },
+    { 1, 0, false, 4, 381770, 380590 },
+    { 1, 0, true, 1, 51, 51 },
+    { 1, 0, true, 2, 2056, 1681 },
+    { 1, 0, true, 3, 116141, 82520 },
+    { 1, 0, true, 4, 5261400, 2775737 },
+    { 1, 1, false, 1, 17, 17 },
+    { 1, 1, false, 2, 155, 155 },
+    { 1, 1, false, 3, 5557, 5557 },
+    { 1, 1, false, 4, 99729, 99729 },
+    { 1, 1, true, 1, 26, 26 },
+    { 1, 1, true, 2, 1230, 1122 },
+    { 1, 1, true, 3, 44050, 31111 },
+    { 1, 1, true, 4, 2411207, 1445223 },
+};
+
+/* Set of 64-bit board hashes, open addressing and doubles when half full.
+ * 0 marks an empty slot so it's never stored. */
+typedef struct HashSet {
+    size_t size;
+    size_t used;
+    uint64_t *keys;
+} HashSet;
+
+/* A block that can be placed next. */
+typedef struct PerftChoice {
+    BlockType type;
+    // the first block that wasn't taken from the queue after this one
+    int next;
+    BlockType hold;
+} PerftChoice;
+
+typedef struct Perft {
+    bool hold;
+    BlockType queue[PERFT_MAX_DEPTH + 2];
+    const Board *board;
+    int depth;
+    // NULL when disabled
+    TranspositionTable *tt;
+    // placements of the first block handed out so far
+    atomic_size_t next_root;
+} Perft;
+
+typedef struct PerftWorker {
+    pthread_t thread;
+    Perft *perft;
+    MoveGen *root_gens[2];
+    MoveGen *gens[PERFT_MAX_DEPTH];
+    uint64_t nodes;
+    uint64_t sequences;
+    uint64_t hits;
+    HashSet boards;
+} PerftWorker;
+
+static void hash_set_init(HashSet *const set, const size_t size) {
+    set->size = size;
+    set->used = 0;
+    set->keys = calloc(size, sizeof(uint64_t));
+    if (set->keys == NULL) {
+        fprintf(stderr, "Couldn't alloc hash set in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void hash_set_add(HashSet *const set, uint64_t key) {
+    if (key == 0)
+        key = 1;
+    if (2 * (set->used + 1) > set->size) {
+        HashSet bigger;
+        hash_set_init(&bigger, 2 * set->size);
+        for (size_t i = 0; i < set->size; i++) {
+            if (set->keys[i])
+                hash_set_add(&bigger, set->keys[i]);
+        }
+        free(set->keys);
+        *set = bigger;
+    }
+    for (size_t i = key & (set->size - 1);; i = (i + 1) & (set->size - 1)) {
+        if (set->keys[i] == key)
+            return;
+        if (set->keys[i] == 0) {
+            set->keys[i] = key;
+            set->used++;
+            return;
+        }
+    }
+}
+
+/* Fills choices with the blocks that can be placed when queue[next] is the
+ * current block and returns how many there are. */
+static int perft_get_choices(
+        const Perft *const perft,
+        const int next,
+        const BlockType hold,
+        PerftChoice choices[2]) {
+    choices[0] = (PerftChoice){ perft->queue[next], next + 1, hold };
+    if (!perft->hold)
+        return 1;
+    // holding the same type as the current block changes nothing
+    if (hold == BLOCK_EMPTY) {
+        choices[1] = (PerftChoice){
+            perft->queue[next + 1],
+            next + 2,
+            perft->queue[next]
+        };
+        return 2;
+    }
+    if (hold != perft->queue[next]) {
+        choices[1] = (PerftChoice){ hold, next + 1, perft->queue[next] };
+        return 2;
+    }
+    return 1;
+}
+
+/* Bakes the block into a copy of board. Returns false on a lock out,
+ * the game is over then and there's nothing more to search. */
+static bool perft_bake(Board *const child, const Board *const board, Block block) {
+    *child = *board;
+    bake(&block, child);
+    return child->rows[FIRST_TRUE_ROW-2] == 0;
+}
+
+static void perft_search(
+        PerftWorker *const worker,
+        const Board *const board,
+        const int depth,
+        const int next,
+        const BlockType hold) {
+    if (depth == 0) {
+        worker->sequences++;
+        hash_set_add(&worker->boards, board->hash);
+        return;
+    }
+
+    const Perft *perft = worker->perft;
+    const uint64_t key = tt_key(board->hash, hold, next, depth);
+    uint64_t stored;
+    if (perft->tt != NULL && tt_probe(perft->tt, key, &stored)) {
+        worker->sequences += stored;
+        worker->hits++;
+        return;
+    }
+
+    const uint64_t before = worker->sequences;
+    PerftChoice choices[2];
+    const int n = perft_get_choices(perft, next, hold, choices);
+    for (int c = 0; c < n; c++) {
+        MoveGen *gen = worker->gens[depth - 1];
+        const size_t placements = movegen_generate(gen, board, choices[c].type);
+        worker->nodes += placements;
+        for (size_t i = 0; i < placements; i++) {
+            Board child;
+            if (perft_bake(&child, board, gen->placements[i]))
+                perft_search(worker, &child, depth - 1, choices[c].next,
+                        choices[c].hold);
+        }
+    }
+    if (perft->tt != NULL)
+        tt_store(perft->tt, key, worker->sequences - before);
+}
+
+/* Every worker generates the placements of the first block itself and
+ * takes them one by one from the shared counter. */
+static void *perft_worker(void *arg) {
+    PerftWorker *worker = arg;
+    Perft *perft = worker->perft;
+
+    PerftChoice choices[2];
+    const int n = perft_get_choices(perft, 0, BLOCK_EMPTY, choices);
+    size_t placements[2];
+    for (int c = 0; c < n; c++) {
+        placements[c] = movegen_generate(
+                worker->root_gens[c],
+                perft->board,
+                choices[c].type);
+    }
+
+    for (;;) {
+        size_t i = atomic_fetch_add(&perft->next_root, 1);
+        int c = 0;
+        while (c < n && i >= placements[c])
+            i -= placements[c++];
+        if (c == n)
+            break;
+
+        worker->nodes++;
+        Board child;
+        if (perft_bake(&child, perft->board, worker->root_gens[c]->placements[i]))
+            perft_search(worker, &child, perft->depth - 1, choices[c].next,
+                    choices[c].hold);
+    }
+    return NULL;
+}
+
+static void position_load(Board *const board, const Position *const position) {
+    board_init(board, BOARD_WIDTH, BOARD_HEIGHT);
+    int rows = 0;
+    while (rows < (int)ARRAY_SIZE(position->rows) && position->rows[rows])
+        rows++;
+    for (int i = 0; i < rows; i++) {
+        const int y = board->height - rows + i;
+        for (int x = 0; x < board->width; x++) {
+            if (position->rows[i][x] == '#')
+                board_set_block(board, x, y, BLOCK_I);
+        }
+    }
+}
+
+/* Current block, the preview and then whatever the bag gives, the same
+ * blocks a game with this seed would get. */
+static void perft_fill_queue(Perft *const perft, const uint64_t seed) {
+    BoardCtx board;
+    GameCtx game;
+    engine_init(&board, &game, seed);
+    const size_t queue_size = ARRAY_SIZE(perft->queue);
+    perft->queue[0] = board.block.type;
+    for (size_t i = 1; i < queue_size; i++) {
+        if (i - 1 < board.buf.used)
+            perft->queue[i] = buf_get_head(&board.buf, i - 1);
+        else
+            perft->queue[i] = seven_bag_get(&game.bag);
+    }
+}
+
+static double get_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void usage(const char *const name) {
+    fprintf(stderr,
+            "usage: %s [-d depth] [-s seed] [-p position] [-H] [-t threads]\n"
+            "       [-T table bits, 0 turns the table off]\n"
+            "       -H allows holding, positions:",
+            name);
+    for (size_t i = 0; i < ARRAY_SIZE(positions); i++)
+        fprintf(stderr, " %s", positions[i].name);
+    fprintf(stderr, "\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    int max_depth = 3;
+    uint64_t seed = 0;
+    int position = 0;
+    bool hold = false;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int tt_bits = 20;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:s:p:Ht:T:")) != -1) {
+        switch (opt) {
+        case 'd':
+            max_depth = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            position = -1;
+            for (size_t i = 0; i < ARRAY_SIZE(positions); i++) {
+                if (strcmp(optarg, positions[i].name) == 0)
+                    position = i;
+            }
+            break;
+        case 'H':
+            hold = true;
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'T':
+            tt_bits = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (max_depth < 1 || max_depth > PERFT_MAX_DEPTH || position < 0 ||
+            threads < 1 || tt_bits < 0 || tt_bits >= 40)
+        usage(argv[0]);
+
+    Board board;
+    position_load(&board, &positions[position]);
+    Perft perft = {
+        .hold = hold,
+        .board = &board,
+        .tt = tt_bits ? tt_create(tt_bits) : NULL
+    };
+    perft_fill_queue(&perft, seed);
+
+    PerftWorker *workers = calloc(threads, sizeof(PerftWorker));
+    if (workers == NULL) {
+        fprintf(stderr, "Couldn't alloc workers in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < threads; t++) {
+        workers[t].perft = &perft;
+        for (int i = 0; i < 2; i++)
+            workers[t].root_gens[i] = movegen_create();
+        for (int i = 0; i < max_depth; i++)
+            workers[t].gens[i] = movegen_create();
+    }
+
+    printf("position %s, seed %llu, hold %s, threads %d, queue",
+            positions[position].name,
+            (unsigned long long)seed,
+            hold ? "on" : "off",
+            threads);
+    for (int i = 0; i < max_depth + hold; i++)
+        printf(" %d", perft.queue[i]);
+    printf("\n");
+
+    bool failed = false;
+    for (int depth = 1; depth <= max_depth; depth++) {
+        perft.depth = depth;
+        atomic_store(&perft.next_root, 0);
+        if (perft.tt != NULL)
+            tt_clear(perft.tt);
+        for (int t = 0; t < threads; t++) {
+            workers[t].nodes = 0;
+            workers[t].sequences = 0;
+            workers[t].hits = 0;
+            hash_set_init(&workers[t].boards, 1024);
+        }
+
+        const double start = get_seconds();
+        for (int t = 0; t < threads; t++) {
+            if (pthread_create(&workers[t].thread, NULL, perft_worker, &workers[t])) {
+                perror("pthread_create");
+                exit(EXIT_FAILURE);
+            }
+        }
+        uint64_t nodes = 0;
+        uint64_t sequences = 0;
+        uint64_t hits = 0;
+        for (int t = 0; t < threads; t++) {
+            pthread_join(workers[t].thread, NULL);
+            nodes += workers[t].nodes;
+            sequences += workers[t].sequences;
+            hits += workers[t].hits;
+        }
+        HashSet *boards = &workers[0].boards;
+        for (int t = 1; t < threads; t++) {
+            for (size_t i = 0; i < workers[t].boards.size; i++) {
+                if (workers[t].boards.keys[i])
+                    hash_set_add(boards, workers[t].boards.keys[i]);
+            }
+        }
+        const double time = get_seconds() - start;
+
+        const char *check = "";
+        for (size_t i = 0; i < ARRAY_SIZE(expected); i++) {
+            const Expected *e = &expected[i];
+            if (e->position != position || e->seed != seed ||
+                    e->hold != hold || e->depth != depth)
+                continue;
+            if (e->sequences == sequences && e->boards == boards->used) {
+                check = " ok";
+            } else {
+                check = " MISMATCH";
+                failed = true;
+            }
+        }
+        printf("depth %d: %llu sequences, %zu boards, %llu nodes, "
+                "%llu tt hits, %.3f s, %.0f nodes/s%s\n",
+                depth,
+                (unsigned long long)sequences,
+                boards->used,
+                (unsigned long long)nodes,
+                (unsigned long long)hits,
+                time,
+                time > 0 ? nodes / time : 0,
+                check);
+        for (int t = 0; t < threads; t++)
+            free(workers[t].boards.keys);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        for (int i = 0; i < 2; i++)
+            movegen_destroy(workers[t].root_gens[i]);
+        for (int i = 0; i < max_depth; i++)
+            movegen_destroy(workers[t].gens[i]);
+    }
+    free(workers);
+    if (perft.tt != NULL)
+        tt_destroy(perft.tt);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
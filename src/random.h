@@ -0,0 +1,17 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+/* splitmix64, returns the next 64 random looking bits of state. The hash
+ * keys are made with it so they have to come out the same in every run,
+ * the simulator's random inputs use it too. The bags have their own
+ * generator (PCG32 in block.c). */
+static inline uint64_t splitmix64(uint64_t *const state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+#endif
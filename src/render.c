@@ -1,9 +1,14 @@
 #include <curses.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "ansi.h"
 #include "block.h"
 #include "circular_buffer.h"
 #include "debug.h"
+#include "frame_clock.h"
 #include "render.h"
+#include "terminal.h"
 #include "util.h"
 #include "window.h"
 
@@ -13,54 +18,116 @@ void render_debug(
         ) {
     for (size_t i = 0; i < debug->nolines; i++) {
         int idx = buf_get_tail(debug->line_index_buf, i);
-        mvwprintw(window->win, i, 1, "%s", debug->lines[idx]);
+        window_print(window, 1, i, "%s", debug->lines[idx]);
     }
 }
 
+// Set between render_begin and render_end when the game is drawn by the
+// ansi backend instead of curses.
+static Ansi *ansi = NULL;
+// when the first window of the frame was staged, 0 before that
+static long long frame_start_ns = 0;
+
+/* A game is about to be drawn with backend. The menus are always drawn by
+ * curses so the backend is only switched for the game. */
+void render_begin(const RenderBackend backend) {
+    frame_start_ns = 0;
+    if (backend == RENDER_BACKEND_ANSI)
+        ansi = ansi_create();
+}
+
+void render_end(void) {
+    if (ansi != NULL) {
+        ansi_destroy(ansi);
+        ansi = NULL;
+    }
+}
+
+/* Hands the cells of the window that changed to the backend, nothing
+ * reaches the terminal until render_present. */
+void render_stage(Window *const window) {
+    if (frame_start_ns == 0)
+        frame_start_ns = frame_clock_get_time_ns();
+    if (ansi != NULL) {
+        ansi_stage(ansi, window);
+        return;
+    }
+    window_flush(window);
+    wnoutrefresh(window->win);
+}
+
+/* Sends every window staged since the last call to the terminal, once per
+ * frame no matter how many boards there are: a single doupdate or a single
+ * write with the ansi backend. With sync the terminal is told to show the
+ * frame all at once instead of drawing it while it arrives. Returns the
+ * bytes, writes and time it took. */
+TerminalIo render_present(const bool sync) {
+    TerminalIo io;
+    if (ansi != NULL) {
+        io = ansi_present(ansi, sync);
+    } else {
+        const TerminalIo before = terminal_get_io();
+        // Written directly on both sides, curses only flushes its buffer
+        // when doupdate has something to draw so a putp'd begin could be
+        // left behind without its end.
+        if (sync && write(STDOUT_FILENO, TERMINAL_SYNC_BEGIN, strlen(TERMINAL_SYNC_BEGIN)) < 0)
+            debug("couldn't begin the synchronized update");
+        doupdate();
+        if (sync && write(STDOUT_FILENO, TERMINAL_SYNC_END, strlen(TERMINAL_SYNC_END)) < 0)
+            debug("couldn't end the synchronized update");
+        const TerminalIo after = terminal_get_io();
+        io = (TerminalIo){
+            .bytes = after.bytes - before.bytes,
+            .writes = after.writes - before.writes
+        };
+    }
+    const long long now = frame_clock_get_time_ns();
+    io.ns = frame_start_ns ? now - frame_start_ns : 0;
+    frame_start_ns = 0;
+    return io;
+}
+
 void render_tile(
         Window *const window,
         const BlockColor color,
         const int x,
         const int y) {
-    wattron(window->win, COLOR_PAIR(color));
     for (int wx = 0; wx < BLOCK_WIDTH; wx++) {
         for (int wy = 0; wy < BLOCK_HEIGHT; wy++) {
-            mvwaddch(window->win,
-                    y*BLOCK_HEIGHT + wy + 1,
+            window_put(window,
                     x*BLOCK_WIDTH + wx + 1,
-                    ':');
+                    y*BLOCK_HEIGHT + wy + 1,
+                    ':' | COLOR_PAIR(color));
         }
     }
-    wattroff(window->win, COLOR_PAIR(color));
 }
 
 void render_block(
         Window *const window,
         const Block *const block,
         const BlockColor color) {
-    for (int x = 0; x < BLOCK_ARR_DIM; x++) {
-        for (int y = 0; y < BLOCK_ARR_DIM; y++) {
-            if (block_get_tile(block, x, y)) {
-                render_tile(window, color, block->x+x, block->y+y);
-            }
-        }
+    const PieceMask *mask = block_get_mask(block->type, block->rot);
+    for (int y = mask->min_y; y <= mask->max_y; y++) {
+        for (unsigned bits = mask->rows[y]; bits; bits &= bits - 1)
+            render_tile(window, color, block->x+__builtin_ctz(bits), block->y+y);
     }
 }
 
+/* Goes row by row over the occupied tiles of the row masks, empty rows and
+ * tiles are never looked at. */
 void render_board(Window *const window, const Board *const board) {
-    box(window->win, 0, 0);
-    for (int x = 0; x < board->width; x++) {
-        for (int y = FIRST_TRUE_ROW; y < board->height; y++) {
-            BlockType type = *board_get_block(board, x, y);
-            if (type != BLOCK_EMPTY) {
-                render_tile(window, block_get_color(type), x, y-FIRST_TRUE_ROW);
-            }
+    window_box(window);
+    for (int y = FIRST_TRUE_ROW; y < board->height; y++) {
+        for (unsigned bits = board->rows[y]; bits; bits &= bits - 1) {
+            const int x = __builtin_ctz(bits);
+            const BlockType type = board_get_block(board, x, y);
+            render_tile(window, block_get_color(type), x, y-FIRST_TRUE_ROW);
         }
     }
 }
 
 void render_buf(Window *const window, const CircularBuffer *const buf) {
-    box(window->win, 0, 0);
+    window_box(window);
     for (size_t i = 0; i < buf->size; i++) {
         Block block = {
             .type = buf_get_head(buf, i),
@@ -73,16 +140,16 @@ void render_buf(Window *const window, const CircularBuffer *const buf) {
 }
 
 void render_stats(Window *const window, const Stats *const stats) {
-    box(window->win, 0, 0);
-    mvwprintw(window->win, 1, 1, "rows: %d", stats->rows);
-    mvwprintw(window->win, 2, 1, "blocks: %d", stats->blocks);
-    mvwprintw(window->win, 3, 1, "combo: %d", stats->combo);
-    mvwprintw(window->win, 4, 1, "level: %d", stats->level);
-    mvwprintw(window->win, 5, 1, "score: %d", stats->score);
+    window_box(window);
+    window_print(window, 1, 1, "rows: %d", stats->rows);
+    window_print(window, 1, 2, "blocks: %d", stats->blocks);
+    window_print(window, 1, 3, "combo: %d", stats->combo);
+    window_print(window, 1, 4, "level: %d", stats->level);
+    window_print(window, 1, 5, "score: %d", stats->score);
 }
 
 void render_hold_box(Window *const window, HoldBox *const hold) {
-    box(window->win, 0, 0);
+    window_box(window);
     Block block = {
         .type = hold->curr_type,
         .x = 0,
@@ -96,9 +163,9 @@ void render_hold_box(Window *const window, HoldBox *const hold) {
 void render_block_delay(
         Window *const window,
         const LockPieceDelay *const block_delay) {
-    box(window->win, 0, 0);
+    window_box(window);
     for (int i = 0; i < block_delay->left_moves; i++)
-        mvwaddch(window->win, 1, 2+i, '*');
+        window_put(window, 2+i, 1, '*');
     for (int i = 0; i < ((double)block_delay->left_frames/LOCK_DEFAULT_FRAMES)*15; i++)
-        mvwaddch(window->win, 2, 2+i, '#');
+        window_put(window, 2+i, 2, '#');
 }
@@ -7,6 +7,12 @@
 #include "board.h"
 #include "circular_buffer.h"
 #include "debug.h"
+#include "terminal.h"
+
+typedef enum RenderBackend {
+    RENDER_BACKEND_CURSES,
+    RENDER_BACKEND_ANSI
+} RenderBackend;
 
 void render_block(
         Window *const window,
@@ -27,5 +33,9 @@ void render_block_delay(
 void render_debug(
         Window *const window,
         const Debug *const debug);
+void render_begin(const RenderBackend backend);
+void render_end(void);
+void render_stage(Window *const window);
+TerminalIo render_present(const bool sync);
 
 #endif
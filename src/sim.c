@@ -0,0 +1,359 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "block.h"
+#include "board_features.h"
+#include "bot.h"
+#include "engine.h"
+#include "env_batch.h"
+#include "random.h"
+
+/* Headless simulator. Runs a batch of independent games on a pool of
+ * threads as fast as possible, only the engine is linked in so there's no
+ * terminal and no sleeping between frames. Game i is seeded with seed+i so
+ * the whole batch is reproducible no matter how many threads run it. */
+
+#define SIM_MAX_INPUTS (BOT_MAX_PATH + 1)
+
+typedef enum Policy {
+    POLICY_IDLE,
+    POLICY_RANDOM,
+    POLICY_SCRIPT,
+    POLICY_BOT
+} Policy;
+
+typedef struct SimConfig {
+    long long games;
+    long long max_frames;
+    int threads;
+    uint64_t seed;
+    Policy policy;
+    const char *script;
+    BotConfig bot;
+    // games stepped together through an EnvBatch, 0 plays them one by one
+    int batch;
+} SimConfig;
+
+typedef struct SimStats {
+    long long games;
+    long long frames;
+    long long pieces;
+    long long rows;
+    double cpu_seconds;
+} SimStats;
+
+typedef struct SimWorker {
+    pthread_t thread;
+    const SimConfig *config;
+    atomic_llong *next_game;
+    // only for the bot policy
+    Bot *bot;
+    SimStats stats;
+} SimWorker;
+
+static Input script_char_to_input(const char c) {
+    switch (c) {
+    case 'l':
+        return INPUT_LEFT;
+    case 'r':
+        return INPUT_RIGHT;
+    case 'd':
+        return INPUT_SOFT_DROP;
+    case 'h':
+        return INPUT_HARD_DROP;
+    case 'x':
+        return INPUT_ROTATE_CW;
+    case 'z':
+        return INPUT_ROTATE_CCW;
+    case 'a':
+        return INPUT_ROTATE_180;
+    case 'c':
+        return INPUT_HOLD;
+    default:
+        return INPUT_NONE;
+    }
+}
+
+/* Fills inputs with what the policy presses this frame and returns how
+ * many there are. */
+static size_t policy_get_inputs(
+        const SimConfig *const config,
+        Bot *const bot,
+        const BoardCtx *const board,
+        const long long frame,
+        uint64_t *const rng,
+        Input *const inputs) {
+    switch (config->policy) {
+    case POLICY_IDLE:
+        return 0;
+    case POLICY_RANDOM:
+        // roughly a key press every 8 frames, hard drops are rarer so the
+        // pieces get moved around a bit before they land
+        if (splitmix64(rng) % 8 != 0)
+            return 0;
+        inputs[0] = INPUT_LEFT + splitmix64(rng) % (INPUT_QUIT - INPUT_LEFT);
+        if (inputs[0] == INPUT_HARD_DROP && splitmix64(rng) % 4 != 0)
+            inputs[0] = INPUT_SOFT_DROP;
+        return 1;
+    case POLICY_SCRIPT:
+        // one character of the script per frame, starting over at the end
+        inputs[0] = script_char_to_input(
+                config->script[frame % strlen(config->script)]);
+        return inputs[0] != INPUT_NONE;
+    case POLICY_BOT:
+        return bot_get_inputs(bot, board, inputs, SIM_MAX_INPUTS);
+    default:
+        fprintf(stderr, "weird policy\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static double get_seconds(const clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void sim_game(SimWorker *const worker, const long long index) {
+    const SimConfig *config = worker->config;
+    BoardCtx board;
+    GameCtx game;
+    engine_init(&board, &game, config->seed + index);
+    uint64_t rng = config->seed ^ (uint64_t)index << 32;
+
+    long long frame = 0;
+    bool over = false;
+    while (!over && frame < config->max_frames) {
+        Input inputs[SIM_MAX_INPUTS];
+        size_t n = policy_get_inputs(
+                config,
+                worker->bot,
+                &board,
+                frame,
+                &rng,
+                inputs);
+        over = engine_step(&board, &game, inputs, n);
+        frame++;
+    }
+
+    worker->stats.games++;
+    worker->stats.frames += frame;
+    worker->stats.pieces += board.stats.blocks;
+    worker->stats.rows += board.stats.rows;
+}
+
+/* Plays the games config->batch at a time. Every game gets the same seed
+ * and inputs as in sim_game so the totals come out the same. */
+static void sim_batch(SimWorker *const worker) {
+    const SimConfig *config = worker->config;
+    const int size = config->batch;
+    EnvBatch *env = env_batch_create(size, config->seed);
+    Input *actions = calloc(size, sizeof(Input));
+    uint64_t *rngs = calloc(size, sizeof(uint64_t));
+    if (actions == NULL || rngs == NULL) {
+        fprintf(stderr, "Couldn't alloc actions in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+
+    for (;;) {
+        const long long first = atomic_fetch_add(worker->next_game, size);
+        if (first >= config->games)
+            break;
+        const long long left = config->games - first;
+        const int count = left < size ? left : size;
+        for (int i = 0; i < size; i++) {
+            if (i < count) {
+                env_batch_reset(env, i, config->seed + first + i);
+                rngs[i] = config->seed ^ (uint64_t)(first + i) << 32;
+            } else {
+                env->over[i] = true;
+            }
+        }
+
+        int running = count;
+        for (long long frame = 0; running && frame < config->max_frames; frame++) {
+            for (int i = 0; i < count; i++) {
+                Input inputs[SIM_MAX_INPUTS];
+                if (env->over[i])
+                    continue;
+                const size_t n = policy_get_inputs(
+                        config,
+                        NULL,
+                        NULL,
+                        frame,
+                        &rngs[i],
+                        inputs);
+                actions[i] = n ? inputs[0] : INPUT_NONE;
+            }
+            running = env_batch_step(env, actions);
+        }
+
+        for (int i = 0; i < count; i++) {
+            worker->stats.games++;
+            // the frame that ended the game doesn't count in fps_counter
+            worker->stats.frames += env->fps_counter[i] + (env->over[i] != 0);
+            worker->stats.pieces += env->stats.blocks[i];
+            worker->stats.rows += env->stats.rows[i];
+        }
+    }
+
+    free(rngs);
+    free(actions);
+    env_batch_destroy(env);
+}
+
+static void *sim_worker(void *arg) {
+    SimWorker *worker = arg;
+    const double start = get_seconds(CLOCK_THREAD_CPUTIME_ID);
+    // games run in parallel already so every bot searches on one thread
+    if (worker->config->policy == POLICY_BOT)
+        worker->bot = bot_create(&worker->config->bot);
+
+    if (worker->config->batch > 0)
+        sim_batch(worker);
+    for (;;) {
+        long long index = atomic_fetch_add(worker->next_game, 1);
+        if (index >= worker->config->games)
+            break;
+        sim_game(worker, index);
+    }
+    if (worker->bot != NULL)
+        bot_destroy(worker->bot);
+
+    worker->stats.cpu_seconds = get_seconds(CLOCK_THREAD_CPUTIME_ID) - start;
+    return NULL;
+}
+
+static void usage(const char *const name) {
+    fprintf(stderr,
+            "usage: %s [-g games] [-t threads] [-f max frames per game]\n"
+            "       [-s seed] [-p idle|random|script|bot] [-S script]\n"
+            "       [-b bot beam width] [-d bot search depth]\n"
+            "       [-e games per batch, not with the bot]\n"
+            "script characters, one per frame: l left, r right, d soft drop,\n"
+            "h hard drop, x cw, z ccw, a 180, c hold, anything else nothing\n",
+            name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    SimConfig config = {
+        .games = 1000,
+        .max_frames = 100000,
+        .threads = sysconf(_SC_NPROCESSORS_ONLN),
+        .seed = 0,
+        .policy = POLICY_RANDOM,
+        .script = "lxhrrzhdlah",
+        .bot = default_bot_config
+    };
+    config.bot.threads = 1;
+    config.bot.inputs_per_frame = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "g:t:f:s:p:S:b:d:e:")) != -1) {
+        switch (opt) {
+        case 'g':
+            config.games = atoll(optarg);
+            break;
+        case 't':
+            config.threads = atoi(optarg);
+            break;
+        case 'f':
+            config.max_frames = atoll(optarg);
+            break;
+        case 's':
+            config.seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            if (strcmp(optarg, "idle") == 0)
+                config.policy = POLICY_IDLE;
+            else if (strcmp(optarg, "random") == 0)
+                config.policy = POLICY_RANDOM;
+            else if (strcmp(optarg, "script") == 0)
+                config.policy = POLICY_SCRIPT;
+            else if (strcmp(optarg, "bot") == 0)
+                config.policy = POLICY_BOT;
+            else
+                usage(argv[0]);
+            break;
+        case 'S':
+            config.policy = POLICY_SCRIPT;
+            config.script = optarg;
+            break;
+        case 'b':
+            config.bot.beam_width = atoi(optarg);
+            break;
+        case 'd':
+            config.bot.depth = atoi(optarg);
+            break;
+        case 'e':
+            config.batch = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (config.threads < 1 || config.games < 0 || strlen(config.script) == 0)
+        usage(argv[0]);
+    // the policy of a batch doesn't get to see the boards
+    if (config.batch < 0 || (config.batch > 0 && config.policy == POLICY_BOT))
+        usage(argv[0]);
+
+    SimWorker *workers = calloc(config.threads, sizeof(SimWorker));
+    if (workers == NULL) {
+        fprintf(stderr, "Couldn't alloc workers in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    atomic_llong next_game = 0;
+
+    const double start = get_seconds(CLOCK_MONOTONIC);
+    for (int i = 0; i < config.threads; i++) {
+        workers[i].config = &config;
+        workers[i].next_game = &next_game;
+        if (pthread_create(&workers[i].thread, NULL, sim_worker, &workers[i])) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    SimStats total = { 0 };
+    for (int i = 0; i < config.threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total.games += workers[i].stats.games;
+        total.frames += workers[i].stats.frames;
+        total.pieces += workers[i].stats.pieces;
+        total.rows += workers[i].stats.rows;
+        total.cpu_seconds += workers[i].stats.cpu_seconds;
+    }
+    const double wall = get_seconds(CLOCK_MONOTONIC) - start;
+
+    printf("games: %lld, frames: %lld, pieces: %lld, rows: %lld\n",
+            total.games, total.frames, total.pieces, total.rows);
+    if (config.policy == POLICY_BOT)
+        printf("bot features kernel: %s\n", features_get_kernel_name());
+    printf("wall: %.3f s, %.1f games/s, %.0f frames/s, %.0f pieces/s\n",
+            wall, total.games / wall, total.frames / wall, total.pieces / wall);
+    for (int i = 0; i < config.threads; i++) {
+        const SimStats *stats = &workers[i].stats;
+        printf("thread %d: %lld games, %.1f games/s, %.0f frames/s\n",
+                i,
+                stats->games,
+                stats->cpu_seconds > 0 ? stats->games / stats->cpu_seconds : 0,
+                stats->cpu_seconds > 0 ? stats->frames / stats->cpu_seconds : 0);
+    }
+    if (total.cpu_seconds > 0) {
+        printf("per core: %.1f games/s, %.0f frames/s\n",
+                total.games / total.cpu_seconds,
+                total.frames / total.cpu_seconds);
+    }
+
+    free(workers);
+    return EXIT_SUCCESS;
+}
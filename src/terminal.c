@@ -0,0 +1,89 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "frame_clock.h"
+#include "terminal.h"
+
+/* Looks for the answers in reply, returns true once the device attributes
+ * answer is there. */
+static bool terminal_parse_answers(const char *const reply, TerminalCaps *const caps) {
+    // every answer is "\033[?" then digits and semicolons and then u for
+    // the kitty flags, $y for a mode and c for the attributes
+    for (const char *answer = strstr(reply, "\033[?");
+            answer != NULL;
+            answer = strstr(answer + 1, "\033[?")) {
+        const char *end = answer + strlen("\033[?");
+        end += strspn(end, "0123456789;");
+        if (*end == 'u') {
+            caps->kitty_keyboard = true;
+        } else if (*end == '$' && end[1] == 'y') {
+            // 1 set, 2 reset, 0 unknown and 4 permanently reset
+            int mode, state;
+            if (sscanf(answer, "\033[?%d;%d$y", &mode, &state) == 2 &&
+                    mode == 2026 && (state == 1 || state == 2))
+                caps->sync_output = true;
+        } else if (*end == 'c') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Asks for the kitty keyboard flags, the synchronized update mode and then
+ * the device attributes. Every terminal answers the last one so there's no
+ * waiting for the timeout unless the terminal is really slow, whatever
+ * wasn't answered before it isn't supported. Has to be called before
+ * curses reads anything. */
+TerminalCaps terminal_query(void) {
+    static const char query[] = "\033[?u\033[?2026$p\033[c";
+    TerminalCaps caps = { 0 };
+    if (write(STDOUT_FILENO, query, strlen(query)) != (ssize_t)strlen(query))
+        return caps;
+
+    char reply[256];
+    size_t len = 0;
+    const long long deadline = frame_clock_get_time_ns() + TERMINAL_QUERY_TIMEOUT_NS;
+    while (len < sizeof(reply) - 1) {
+        const long long left = deadline - frame_clock_get_time_ns();
+        struct pollfd fd = { .fd = STDIN_FILENO, .events = POLLIN };
+        if (left <= 0 || poll(&fd, 1, left / 1000000 + 1) <= 0)
+            break;
+        const ssize_t ret = read(STDIN_FILENO, reply + len, sizeof(reply) - 1 - len);
+        if (ret <= 0)
+            break;
+        len += ret;
+        reply[len] = '\0';
+        if (terminal_parse_answers(reply, &caps))
+            return caps;
+    }
+    // no attributes answer, don't trust the rest
+    return (TerminalCaps){ 0 };
+}
+
+/* From /proc/thread-self/io so it counts every write of this thread, the
+ * ones curses makes too. Zeros when it can't be read. */
+TerminalIo terminal_get_io(void) {
+    static int fd = -2;
+    TerminalIo io = { 0 };
+    if (fd == -2)
+        fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return io;
+
+    char buf[512];
+    const ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+        return io;
+    buf[len] = '\0';
+    const char *wchar = strstr(buf, "wchar: ");
+    const char *syscw = strstr(buf, "syscw: ");
+    if (wchar != NULL)
+        io.bytes = atoll(wchar + strlen("wchar: "));
+    if (syscw != NULL)
+        io.writes = atoll(syscw + strlen("syscw: "));
+    return io;
+}
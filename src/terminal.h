@@ -0,0 +1,36 @@
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+#include <stdbool.h>
+
+/* What the terminal can do beyond what terminfo says, found out by asking
+ * it at startup, and what writing to it costs. */
+
+// how long to wait for the terminal to answer the queries
+#define TERMINAL_QUERY_TIMEOUT_NS 500000000ll
+
+// begin and end synchronized update (DEC mode 2026), the terminal shows
+// everything between them at once
+#define TERMINAL_SYNC_BEGIN "\033[?2026h"
+#define TERMINAL_SYNC_END "\033[?2026l"
+
+typedef struct TerminalCaps {
+    // reports key releases with the kitty keyboard protocol (CSI u)
+    bool kitty_keyboard;
+    bool sync_output;
+} TerminalCaps;
+
+// Totals of the calling thread, the difference of two is what happened
+// in between.
+typedef struct TerminalIo {
+    long long bytes;
+    long long writes;
+    // only for a frame, the time from the first window staged until it
+    // was written
+    long long ns;
+} TerminalIo;
+
+TerminalCaps terminal_query(void);
+TerminalIo terminal_get_io(void);
+
+#endif
@@ -1,8 +1,11 @@
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
 #include <form.h>
 #include <locale.h>
 #include <menu.h>
 #include <ncurses.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -13,15 +16,110 @@
 #include "board.h"
 #include "circular_buffer.h"
 #include "debug.h"
+#include "engine.h"
+#include "frame_clock.h"
+#include "input.h"
 #include "multiplayer.h"
 #include "render.h"
+#include "terminal.h"
 #include "tetris.h"
 #include "util.h"
 #include "window.h"
 
 State current_state = STATE_TITLE;
 
-int main(void) {
+// Seed given with -s, every game started uses it so a game can be replayed.
+static bool fixed_seed = false;
+static uint64_t seed = 0;
+// Bot used in the watch bot and versus bot modes, -t sets its threads.
+static BotConfig bot_config;
+// -i evdev reads the keyboard device instead of the terminal.
+static InputBackend input_backend = INPUT_BACKEND_TERMINAL;
+static InputCtx *input;
+// what the terminal answered at startup
+static TerminalCaps terminal_caps;
+// -r ansi draws the games without curses
+static RenderBackend render_backend = RENDER_BACKEND_CURSES;
+// -D, -A and -F, only the player's keys repeat with these.
+static Handling handling;
+
+static void usage(const char *const name) {
+    fprintf(stderr,
+            "usage: %s [-s seed] [-t bot threads] [-i terminal|evdev]\n"
+            "       [-D das ms] [-A arr ms] [-F soft drop factor]\n"
+            "       [-r curses|ansi]\n",
+            name);
+    exit(EXIT_FAILURE);
+}
+
+/* The engine counts in frames, the options are in ms like in other games.
+ * Rounds to the nearest frame but anything above 0 is at least a frame,
+ * an ARR of 0 is a different thing (straight to the wall) than a fast
+ * one. */
+static int ms_to_frames(const int ms) {
+    const int frames = ((long long)ms * FPS + 500) / 1000;
+    return ms > 0 && frames == 0 ? 1 : frames;
+}
+
+/* The number in arg, exits with the usage when it's not a number or
+ * negative. */
+static int parse_non_negative(const char *const arg, const char *const name) {
+    char *end;
+    errno = 0;
+    const long value = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || value < 0 || value > INT_MAX)
+        usage(name);
+    return value;
+}
+
+int main(int argc, char *argv[]) {
+    bot_config = default_bot_config;
+    handling = default_handling;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:i:D:A:F:r:")) != -1) {
+        switch (opt) {
+        case 's':
+            fixed_seed = true;
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            bot_config.threads = atoi(optarg);
+            break;
+        case 'D':
+            handling.das = ms_to_frames(parse_non_negative(optarg, argv[0]));
+            break;
+        case 'A':
+            handling.arr = ms_to_frames(parse_non_negative(optarg, argv[0]));
+            break;
+        case 'F':
+            handling.sdf = parse_non_negative(optarg, argv[0]);
+            break;
+        case 'r':
+            if (strcmp(optarg, "ansi") == 0) {
+                render_backend = RENDER_BACKEND_ANSI;
+                break;
+            } else if (strcmp(optarg, "curses") == 0) {
+                render_backend = RENDER_BACKEND_CURSES;
+                break;
+            }
+            usage(argv[0]);
+            break;
+        case 'i':
+            if (strcmp(optarg, "evdev") == 0) {
+                input_backend = INPUT_BACKEND_EVDEV;
+                break;
+            } else if (strcmp(optarg, "terminal") == 0) {
+                input_backend = INPUT_BACKEND_TERMINAL;
+                break;
+            }
+            usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
     init();
 
     while (current_state != STATE_EXIT) {
@@ -35,6 +133,12 @@ int main(void) {
         case STATE_MULTIPLAYER:
             multiplayer();
             break;
+        case STATE_BOT:
+            watch_bot();
+            break;
+        case STATE_VERSUS_BOT:
+            versus_bot();
+            break;
         case STATE_SETTINGS:
             break;
         default:
@@ -72,13 +176,17 @@ void init(void) {
     init_pair(BLOCK_COLOR_SHADOW, COLOR_WHITE, COLOR_BLACK);
     init_pair(69, COLOR_RED, COLOR_RED);
 
-    srand(time(NULL));
-
     init_debug_ctx();
     debug("debug_ctx created");
+
+    terminal_caps = terminal_query();
+    input = input_create(input_backend, terminal_caps.kitty_keyboard);
+    if (terminal_caps.sync_output)
+        debug("the terminal has synchronized updates");
 }
 
 void uninit(void) {
+    input_destroy(input);
     uninit_debug_ctx();
 
     curs_set(1);
@@ -90,75 +198,70 @@ void singleplayer(void) {
     RenderCtx render;
     GameCtx game;
 
+    FrameClock clock;
+    PendingKeys keys;
+
     init_singleplayer(&board, &render, &game);
+    frame_clock_init(&clock, FPS);
+    input_begin(input);
+    // nothing held in the menus carries over into the game
+    engine_release_keys(&game);
+    render_begin(render_backend);
     while (!game.quit) {
-        singleplayer_input(&board, &game);
-        singleplayer_logic(&board, &game);
-        singleplayer_render(&board, &render);
-
-        // After everything sleep... if we assume the program takes 0 zero
-        // to process everything this will keep a constant frame rate.
-        // This is bad but good enough for this simple tetris implementation.
-        usleep(1000000/FPS);
+        // The logic runs FPS times a second of real time no matter how
+        // long rendering took, a few ticks at once after a stall. Keys wake
+        // it up too so they're applied right away and not at the next tick.
+        const int ticks = frame_clock_wait(&clock, input->fd);
+        pending_keys_read(&keys);
+        for (int i = 0; i < ticks && !game.quit; i++) {
+            singleplayer_input(
+                    &board,
+                    &game,
+                    &keys,
+                    frame_clock_get_tick_ns(&clock, ticks, i));
+            singleplayer_logic(&board, &game);
+        }
+        // the keys after the last tick go in right away
+        singleplayer_input(&board, &game, &keys, LLONG_MAX);
+        // a frame where nothing changed isn't drawn at all
+        if (singleplayer_render(&board, &render) || debug_changed())
+            present_frame();
     }
-    uninit_singleplayer(&board, &render, &game);
+    render_end();
+    input_end(input);
+    frame_clock_uninit(&clock);
+    uninit_singleplayer(&render);
 }
 
-void init_singleplayer(BoardCtx *board, RenderCtx *render, GameCtx *game) {
-    *game = (GameCtx) {
-        .bag = seven_bag_create(),
-        .fps_counter = 0,
-        .rows2add = 0,
-        .move_ret = 0,
-        .swap = false,
-        .to_swap = BLOCK_EMPTY,
-        .last_fall = 0,
-        .quit = false
-    };
-
-    *board = (BoardCtx) {
-        .board = board_create(BOARD_WIDTH, BOARD_HEIGHT),
-        .buf = buf_create(STD_BUF_SIZE),
-        .block = {
-            // because the board row is of size 10 and blocks are of size 4
-            // x = 3 is the middle of the board for blocks.
-            .x = 3,
-            .y = FIRST_TRUE_ROW,
-            .rot = UP,
-            .type = seven_bag_get(game->bag)
-        },
-        .stats = (Stats) {
-            .rows = 0,
-            .blocks = 0,
-            .combo = 0,
-            .level = 1,
-            .score = 0
-        },
-        .hold = (HoldBox) { 
-            .swapped = false,
-            .curr_type = BLOCK_EMPTY
-        },
-        .lock_piece_delay = default_lock_piece_delay,
-        .block_out = false,
-        .lock_out = false
-    };
+uint64_t get_game_seed(void) {
+    if (fixed_seed)
+        return seed;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
 
-    for (size_t i = 0; i < board->buf->size; i++)
-        buf_add_head(board->buf, seven_bag_get(game->bag));
+void init_singleplayer(BoardCtx *board, RenderCtx *render, GameCtx *game) {
+    engine_init(board, game, get_game_seed());
+    game->handling = handling;
+    debug("seed: %llu", (unsigned long long)game->bag.seed);
+    init_render(render, board, 0);
+}
 
+/* Creates the windows of a board shifted x columns to the right. */
+void init_render(RenderCtx *render, const BoardCtx *board, const int x) {
     *render = (RenderCtx) {
-        .board_window = create_window_for_board(board->board, 6, 3),
-        .buf_window = create_window_for_buf(board->buf, 30, 4),
-        .stats_window = create_window_for_stats(39, 4),
-        .hold_box_window = create_window_for_holdbox(39, 10),
-        .block_delay_window = create_window_for_block_delay(6, 25),
+        .board_window = create_window_for_board(&board->board, x+6, 3),
+        .buf_window = create_window_for_buf(&board->buf, x+30, 4),
+        .stats_window = create_window_for_stats(x+39, 4),
+        .hold_box_window = create_window_for_holdbox(x+39, 10),
+        .block_delay_window = create_window_for_block_delay(x+6, 25),
+        // anything but the board's so the first frame gets drawn
+        .generation = board->generation - 1
     };
 }
 
-void uninit_singleplayer(BoardCtx *board, RenderCtx *render, GameCtx *game) {
-    board_destroy(board->board);
-    buf_destroy(board->buf);
-    seven_bag_destroy(game->bag);
+void uninit_singleplayer(RenderCtx *render) {
     window_destroy(render->board_window);
     window_destroy(render->buf_window);
     window_destroy(render->stats_window);
@@ -166,160 +269,50 @@ void uninit_singleplayer(BoardCtx *board, RenderCtx *render, GameCtx *game) {
     window_destroy(render->block_delay_window);
 }
 
-void singleplayer_input(BoardCtx *board, GameCtx *game) {
-    int key = getch();
-    switch (key) {
-        case 'c':
-        case 'C':
-            if (!board->hold.swapped) {
-                game->to_swap = board->hold.curr_type;
-                board->hold.curr_type = board->block.type;
-                board->hold.swapped = true;
-                game->swap = true;
-            }
-            break;
-        case KEY_LEFT:
-            game->move_ret = block_move(&board->block, board->board, -1, 0);
-            break;
-        case KEY_RIGHT:
-            game->move_ret = block_move(&board->block, board->board, 1, 0);
-            break;
-        case KEY_DOWN:
-            game->rows2add += fall(&board->block, board->board);
-            game->last_fall = game->fps_counter;
-            break;
-        case KEY_UP:
-        case 'x':
-        case 'X':
-            game->move_ret = block_rotate_cw(&board->block, board->board);
-            break;
-        case 'z':
-        case 'Z':
-            game->move_ret = block_rotate_ccw(&board->block, board->board);
-            break;
-        case ' ':
-            // hard drop points
-            board->stats.score += 2 * block_get_cell_amount(board->block.type);
-            board->block = cast_block_shadow(&board->block, board->board);
-            game->rows2add += fall(&board->block, board->board);
-            game->last_fall = game->fps_counter;
-            break;
-        case 'q':
-        case 'Q':
-            game->quit = true;
-            break;
-    }
+/* Reads every key pressed or released since the last call. */
+void pending_keys_read(PendingKeys *keys) {
+    keys->n = input_poll(input, keys->events, INPUT_MAX_EVENTS);
+    keys->next = 0;
 }
 
-void singleplayer_logic(BoardCtx *board, GameCtx *game) {
-    // get the delta time that a block should fall after
-    int fall_after = get_fall_after(board->stats.level);
-
-    // if block is on ground use the lock piece delay left frames instead
-    // of last fall and fps counter
-    if (is_block_on_ground(&board->block, board->board)) {
-        board->lock_piece_delay.left_frames--;
-        game->last_fall = game->fps_counter;
-    }
-
-    // if block moved update lock piece delay
-    if (!game->move_ret) {
-        board->lock_piece_delay.left_frames = LOCK_DEFAULT_FRAMES;
-        board->lock_piece_delay.left_moves--;
-    }
-
-    // if no more left frames or moves from piece delay then drop the piece
-    if (board->lock_piece_delay.left_frames <= 0 || 
-            (is_block_on_ground(&board->block, board->board) &&
-             board->lock_piece_delay.left_moves <= 0)) {
-        // a hack so the block would fall instantly
-        game->last_fall = -fall_after;
-        // soft drop points
-        board->stats.score += 1 * block_get_cell_amount(board->block.type);
-    }
-
-    // drop block after certain time of not falling
-    if (game->fps_counter >= game->last_fall+fall_after) {
-        game->rows2add += fall(&board->block, board->board);
-        game->last_fall = game->fps_counter;
-    }
-
-    // create (or get from swap) a new block
-    if (board->block.type == BLOCK_EMPTY || game->swap) {
-        game->last_fall = game->fps_counter;
-        board->lock_piece_delay = default_lock_piece_delay;
-
-        board->block = (Block){
-                .x = 3,
-                .y = FIRST_TRUE_ROW,
-                .rot = UP,
-                .type = game->swap ? game->to_swap : BLOCK_EMPTY
-        };
-        // get a new block from the buffer
-        if (board->block.type == BLOCK_EMPTY) {
-            board->block.type = buf_get_head(board->buf, 0);
-            board->stats.blocks += 1;
-            if (!game->swap)
-                board->hold.swapped = false;
-            buf_remove_head(board->buf);
-            buf_add_tail(board->buf, seven_bag_get(game->bag));
-
-            if (game->rows2add)
-                board->stats.combo += 1;
-            else
-                board->stats.combo = 0;
-        }
-
-        // Check if can put a new block. If not the game is lost.
-        board->block_out = true;
-        for (int i = 0; i < 4; i++) {
-            if (block_can_move(&board->block, board->board, 0, 0)) {
-                board->block_out = false;
-                break;
-            }
-            board->block.y += -1;
-        }
-    }
-
-    // if there's a block in FIRST_TRUE_ROW-2 then game over.
-    for (int i = 0; i < board->board->width; i++) {
-        BlockType block = *board_get_block(board->board, i, FIRST_TRUE_ROW-2);
-        if (block != BLOCK_EMPTY) {
-            board->lock_out = true;
+/* Passes the keys that happened until then to the engine in the order they
+ * happened, the engine repeats the held ones. The loops call it before
+ * every tick with the time the tick was due, a key that went down between
+ * two ticks is applied right before the second one so DAS and ARR count
+ * from when it really went down and not from when the loop got to it. */
+void singleplayer_input(
+        BoardCtx *board,
+        GameCtx *game,
+        PendingKeys *keys,
+        const long long until) {
+    for (; keys->next < keys->n; keys->next++) {
+        const KeyEvent *event = &keys->events[keys->next];
+        if (event->time_ns > until)
             break;
-        }
+        engine_key(board, game, event->input, event->pressed);
     }
+}
 
-    // game over
-    if (board->lock_out || board->block_out) {
+void singleplayer_logic(BoardCtx *board, GameCtx *game) {
+    if (engine_logic(board, game))
         current_state = STATE_TITLE;
-        game->quit = true;
-        return;
-    }
-
-    // don't reset lock piece delay when the block was already on this height
-    if (board->lock_piece_delay.lowest < board->block.y) {
-        board->lock_piece_delay = default_lock_piece_delay;
-        board->lock_piece_delay.lowest = board->block.y;
-    }
-
-    // update variables
-    stats_update(&board->stats, game->rows2add);
-    game->fps_counter++;
-    game->rows2add = 0;
-    game->swap = false;
-    game->move_ret = -1;
 }
 
-void singleplayer_render(BoardCtx *board, RenderCtx *render) {
-    werase(render->board_window->win);
-    werase(render->buf_window->win);
-    werase(render->stats_window->win);
-    werase(render->hold_box_window->win);
-    werase(render->block_delay_window->win);
-
-    render_board(render->board_window, board->board);
-    render_buf(render->buf_window, board->buf);
+/* Draws the board unless it's the same as the last time it was drawn,
+ * returns whether it was. */
+bool singleplayer_render(BoardCtx *board, RenderCtx *render) {
+    if (render->generation == board->generation)
+        return false;
+    render->generation = board->generation;
+
+    window_clear(render->board_window);
+    window_clear(render->buf_window);
+    window_clear(render->stats_window);
+    window_clear(render->hold_box_window);
+    window_clear(render->block_delay_window);
+
+    render_board(render->board_window, &board->board);
+    render_buf(render->buf_window, &board->buf);
     render_stats(render->stats_window, &board->stats);
     render_hold_box(render->hold_box_window, &board->hold);
     render_block_delay(render->block_delay_window, &board->lock_piece_delay);
@@ -329,7 +322,7 @@ void singleplayer_render(BoardCtx *board, RenderCtx *render) {
     // second half of the board as if it was the first half and I don't
     // render the first half (because it's invisible). Without the +/- part
     // the block would render 20 tiles below.
-    Block shadow = cast_block_shadow(&board->block, board->board);
+    Block shadow = cast_block_shadow(&board->block, &board->board);
     shadow.y -= FIRST_TRUE_ROW;
     render_block(render->board_window, &shadow, BLOCK_COLOR_SHADOW);
     shadow.y += FIRST_TRUE_ROW;
@@ -340,13 +333,112 @@ void singleplayer_render(BoardCtx *board, RenderCtx *render) {
             block_get_color(board->block.type));
     board->block.y += FIRST_TRUE_ROW;
 
-    wrefresh(render->board_window->win);
-    wrefresh(render->buf_window->win);
-    wrefresh(render->stats_window->win);
-    wrefresh(render->hold_box_window->win);
-    wrefresh(render->block_delay_window->win);
+    // only the cells that changed since the last frame reach curses, and
+    // the terminal only with present_frame
+    render_stage(render->board_window);
+    render_stage(render->buf_window);
+    render_stage(render->stats_window);
+    render_stage(render->hold_box_window);
+    render_stage(render->block_delay_window);
+    return true;
+}
 
+/* Puts everything rendered since the last call on the terminal at once,
+ * the game loops call it once per frame after rendering all the boards. */
+void present_frame(void) {
     show_debug();
+    const TerminalIo io = render_present(terminal_caps.sync_output);
+    if (debug_ctx != NULL)
+        debug_ctx->frame_io = io;
+}
+
+void watch_bot(void) {
+    BoardCtx board;
+    RenderCtx render;
+    GameCtx game;
+    FrameClock clock;
+    Bot *bot = bot_create(&bot_config);
+
+    init_singleplayer(&board, &render, &game);
+    frame_clock_init(&clock, FPS);
+    input_begin(input);
+    render_begin(render_backend);
+    while (!game.quit) {
+        const int ticks = frame_clock_wait(&clock, input->fd);
+        watch_bot_input(&board, &game);
+        // the bot presses its keys every tick
+        for (int i = 0; i < ticks && !game.quit; i++) {
+            bot_play(bot, &board, &game);
+            singleplayer_logic(&board, &game);
+        }
+        if (singleplayer_render(&board, &render) || debug_changed())
+            present_frame();
+    }
+    render_end();
+    input_end(input);
+    frame_clock_uninit(&clock);
+    uninit_singleplayer(&render);
+    bot_destroy(bot);
+}
+
+/* The bot plays but the player can still quit. */
+void watch_bot_input(BoardCtx *board, GameCtx *game) {
+    KeyEvent events[INPUT_MAX_EVENTS];
+    const size_t n = input_poll(input, events, INPUT_MAX_EVENTS);
+    for (size_t i = 0; i < n; i++) {
+        if (events[i].pressed && events[i].input == INPUT_QUIT)
+            engine_input(board, game, INPUT_QUIT);
+    }
+}
+
+/* The player on the left and the bot on the right get the same blocks,
+ * whoever tops out first loses. */
+void versus_bot(void) {
+    BoardCtx p1_board;
+    RenderCtx p1_render;
+    GameCtx p1_game;
+    BoardCtx p2_board;
+    RenderCtx p2_render;
+    GameCtx p2_game;
+    FrameClock clock;
+    PendingKeys keys;
+    Bot *bot = bot_create(&bot_config);
+
+    init_singleplayer(&p1_board, &p1_render, &p1_game);
+    engine_init(&p2_board, &p2_game, p1_game.bag.seed);
+    init_render(&p2_render, &p2_board, 50);
+    frame_clock_init(&clock, FPS);
+    input_begin(input);
+    // nothing held in the menus carries over into the game
+    engine_release_keys(&p1_game);
+    render_begin(render_backend);
+    while (!p1_game.quit && !p2_game.quit) {
+        const int ticks = frame_clock_wait(&clock, input->fd);
+        pending_keys_read(&keys);
+        for (int i = 0; i < ticks && !p1_game.quit && !p2_game.quit; i++) {
+            singleplayer_input(
+                    &p1_board,
+                    &p1_game,
+                    &keys,
+                    frame_clock_get_tick_ns(&clock, ticks, i));
+            bot_play(bot, &p2_board, &p2_game);
+            singleplayer_logic(&p1_board, &p1_game);
+            singleplayer_logic(&p2_board, &p2_game);
+        }
+        singleplayer_input(&p1_board, &p1_game, &keys, LLONG_MAX);
+        // both boards are looked at, one changing doesn't redraw the other
+        const bool p1_drawn = singleplayer_render(&p1_board, &p1_render);
+        const bool p2_drawn = singleplayer_render(&p2_board, &p2_render);
+        if (p1_drawn || p2_drawn || debug_changed())
+            present_frame();
+    }
+    render_end();
+    input_end(input);
+    frame_clock_uninit(&clock);
+    debug(p2_game.quit && !p1_game.quit ? "you won" : "the bot won");
+    uninit_singleplayer(&p1_render);
+    uninit_singleplayer(&p2_render);
+    bot_destroy(bot);
 }
 
 void multiplayer(void) {
@@ -387,32 +479,17 @@ void multiplayer_init(MultiCtx *ctx) {
     ctx->curr_multi_state = MULTI_STATE_CONNECT;
     init_singleplayer(&ctx->p1_board_ctx, &ctx->p1_render_ctx, &ctx->game_ctx);
 
-    ctx->p2_board_ctx = (BoardCtx) {
-        .board = board_create(BOARD_WIDTH, BOARD_HEIGHT),
-        .buf = buf_create(STD_BUF_SIZE)
-    };
-    for (size_t i = 0; i < ctx->p2_board_ctx.buf->size; i++)
-        buf_add_head(ctx->p2_board_ctx.buf, BLOCK_EMPTY);
-
-    ctx->p2_render_ctx = (RenderCtx) {
-        .board_window = create_window_for_board(
-                ctx->p2_board_ctx.board, 50+6, 3),
-        .buf_window = create_window_for_buf(
-                ctx->p2_board_ctx.buf, 50+30, 4),
-        .stats_window = create_window_for_stats(50+39, 4),
-        .hold_box_window = create_window_for_holdbox(50+39, 10),
-        .block_delay_window = create_window_for_block_delay(50+6, 25)
-    };
+    ctx->p2_board_ctx = (BoardCtx) { 0 };
+    board_init(&ctx->p2_board_ctx.board, BOARD_WIDTH, BOARD_HEIGHT);
+    buf_init(&ctx->p2_board_ctx.buf, STD_BUF_SIZE);
+    for (size_t i = 0; i < ctx->p2_board_ctx.buf.size; i++)
+        buf_add_head(&ctx->p2_board_ctx.buf, BLOCK_EMPTY);
+
+    init_render(&ctx->p2_render_ctx, &ctx->p2_board_ctx, 50);
 }
 
 void multiplayer_uninit(MultiCtx *ctx) {
-    uninit_singleplayer(
-            &ctx->p1_board_ctx,
-            &ctx->p1_render_ctx,
-            &ctx->game_ctx);
-
-    board_destroy(ctx->p2_board_ctx.board);
-    buf_destroy(ctx->p2_board_ctx.buf);
+    uninit_singleplayer(&ctx->p1_render_ctx);
 
     window_destroy(ctx->p2_render_ctx.board_window);
     window_destroy(ctx->p2_render_ctx.buf_window);
@@ -515,6 +592,16 @@ void recv_packet(MultiCtx *ctx) {
     }
 }
 
+/* Reads every packet that already arrived without waiting for more, the
+ * other board ends up as the newest one sent. The other player doesn't
+ * send at the same rate so reading one per frame would fall behind or
+ * wait on them. */
+void recv_pending_packets(MultiCtx *ctx) {
+    struct pollfd pfd = { .fd = ctx->socket, .events = POLLIN };
+    while (poll(&pfd, 1, 0) > 0 && pfd.revents == POLLIN)
+        recv_packet(ctx);
+}
+
 void multiplayer_play(MultiCtx *ctx) {
     debug("multiplayer: start");
 
@@ -551,17 +638,43 @@ void multiplayer_play(MultiCtx *ctx) {
         usleep(1000000);
     }
 
+    FrameClock clock;
+    PendingKeys keys;
+    frame_clock_init(&clock, FPS);
+    input_begin(input);
+    // nothing held in the menus carries over into the game
+    engine_release_keys(&ctx->game_ctx);
+    render_begin(render_backend);
     while (!ctx->game_ctx.quit) {
-        singleplayer_input(&ctx->p1_board_ctx, &ctx->game_ctx);
-        singleplayer_logic(&ctx->p1_board_ctx, &ctx->game_ctx);
-        singleplayer_render(&ctx->p1_board_ctx, &ctx->p1_render_ctx);
-        singleplayer_render(&ctx->p2_board_ctx, &ctx->p2_render_ctx);
-
-        send_board_ctx(&ctx->p1_board_ctx, ctx->socket);
-        recv_packet(ctx);
-
-        usleep(1000000/FPS);
+        const int ticks = frame_clock_wait(&clock, input->fd);
+        pending_keys_read(&keys);
+        for (int i = 0; i < ticks && !ctx->game_ctx.quit; i++) {
+            singleplayer_input(
+                    &ctx->p1_board_ctx,
+                    &ctx->game_ctx,
+                    &keys,
+                    frame_clock_get_tick_ns(&clock, ticks, i));
+            singleplayer_logic(&ctx->p1_board_ctx, &ctx->game_ctx);
+        }
+        singleplayer_input(&ctx->p1_board_ctx, &ctx->game_ctx, &keys, LLONG_MAX);
+        const bool p1_drawn = singleplayer_render(
+                &ctx->p1_board_ctx,
+                &ctx->p1_render_ctx);
+        const bool p2_drawn = singleplayer_render(
+                &ctx->p2_board_ctx,
+                &ctx->p2_render_ctx);
+        if (p1_drawn || p2_drawn || debug_changed())
+            present_frame();
+
+        // The board goes out at most once per wakeup and only when time
+        // passed or it changed, keys wake the loop up without either.
+        if (ticks > 0 || p1_drawn)
+            send_board_ctx(&ctx->p1_board_ctx, ctx->socket);
+        recv_pending_packets(ctx);
     }
+    render_end();
+    input_end(input);
+    frame_clock_uninit(&clock);
 }
 
 void title(void) {
@@ -620,6 +733,12 @@ void title(void) {
             case MULTIPLAYER:
                 current_state = STATE_MULTIPLAYER;
                 break;
+            case WATCH_BOT:
+                current_state = STATE_BOT;
+                break;
+            case VERSUS_BOT:
+                current_state = STATE_VERSUS_BOT;
+                break;
             case SETTINGS:
                 current_state = STATE_SETTINGS;
                 break;
@@ -9,31 +9,17 @@
 #include "board.h"
 #include "circular_buffer.h"
 #include "block.h"
-
-typedef struct Stats {
-    int rows;
-    int blocks;
-    int combo;
-    int level;
-    int score;
-} Stats;
-
-typedef struct HoldBox {
-    bool swapped;
-    BlockType curr_type; 
-} HoldBox; 
-
-typedef struct LockPieceDelay {
-    int left_moves;
-    int left_frames;
-    int lowest;
-} LockPieceDelay;
+#include "bot.h"
+#include "engine.h"
+#include "input.h"
 
 typedef enum State {
     STATE_NULL,
     STATE_TITLE,
     STATE_SINGLEPLAYER,
     STATE_MULTIPLAYER,
+    STATE_BOT,
+    STATE_VERSUS_BOT,
     STATE_SETTINGS,
     STATE_EXIT
 } State;
@@ -46,20 +32,6 @@ typedef enum MultiState {
     MULTI_STATE_PLAYING
 } MultiState;
 
-// This ctx struct is for board related things. In the case of multiplayer
-// there will be multiple of those for each player and every board will be
-// send to and received from server.
-typedef struct BoardCtx {
-    Board *board;
-    CircularBuffer *buf;
-    Block block;
-    Stats stats;
-    HoldBox hold;
-    LockPieceDelay lock_piece_delay;
-    bool block_out;
-    bool lock_out;
-} BoardCtx;
-
 // This ctx struct is for rendering the BoardCtx.
 typedef struct RenderCtx {
     Window *board_window;
@@ -67,19 +39,18 @@ typedef struct RenderCtx {
     Window *stats_window;
     Window *hold_box_window;
     Window *block_delay_window;
+    // BoardCtx.generation of the board when it was last drawn
+    uint32_t generation;
 } RenderCtx;
 
-// This ctx struct is keeping the game state.
-typedef struct GameCtx {
-    SevenBag *bag;
-    long long fps_counter;
-    int rows2add;
-    int move_ret;
-    bool swap;
-    BlockType to_swap;
-    long long last_fall;
-    bool quit;
-} GameCtx;
+// Keys read when the loop wakes up, handed to the engine in between the
+// ticks by when they happened.
+typedef struct PendingKeys {
+    KeyEvent events[INPUT_MAX_EVENTS];
+    size_t n;
+    // the first one not applied yet
+    size_t next;
+} PendingKeys;
 
 typedef struct MultiCtx {
     GameCtx game_ctx;
@@ -94,6 +65,8 @@ typedef struct MultiCtx {
 typedef enum MenuOptions {
     SINGLEPLAYER,
     MULTIPLAYER,
+    WATCH_BOT,
+    VERSUS_BOT,
     SETTINGS,
     EXIT,
     MENU_OPTIONS_SIZE
@@ -102,6 +75,8 @@ typedef enum MenuOptions {
 static const char *const menu_choices[] = {
     [SINGLEPLAYER] = "Singleplayer",
     [MULTIPLAYER] = "Multiplayer",
+    [WATCH_BOT] = "Watch bot",
+    [VERSUS_BOT] = "Versus bot",
     [SETTINGS] = "Settings",
     [EXIT] = "Exit"
 };
@@ -120,10 +95,21 @@ void init(void);
 void uninit(void);
 void singleplayer(void);
 void init_singleplayer(BoardCtx *board, RenderCtx *render, GameCtx *game);
-void uninit_singleplayer(BoardCtx *board, RenderCtx *render, GameCtx *game);
-void singleplayer_input(BoardCtx *board, GameCtx *game);
+void init_render(RenderCtx *render, const BoardCtx *board, const int x);
+uint64_t get_game_seed(void);
+void uninit_singleplayer(RenderCtx *render);
+void pending_keys_read(PendingKeys *keys);
+void singleplayer_input(
+        BoardCtx *board,
+        GameCtx *game,
+        PendingKeys *keys,
+        const long long until);
 void singleplayer_logic(BoardCtx *board, GameCtx *game);
-void singleplayer_render(BoardCtx *board, RenderCtx *render);
+bool singleplayer_render(BoardCtx *board, RenderCtx *render);
+void present_frame(void);
+void watch_bot(void);
+void watch_bot_input(BoardCtx *board, GameCtx *game);
+void versus_bot(void);
 void multiplayer(void);
 void multiplayer_init(MultiCtx *ctx);
 void multiplayer_uninit(MultiCtx *ctx);
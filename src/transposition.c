@@ -0,0 +1,98 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "block.h"
+#include "random.h"
+#include "transposition.h"
+
+static uint64_t hold_keys[BLOCK_MAX];
+static uint64_t queue_keys[TT_MAX_QUEUE];
+static uint64_t depth_keys[TT_MAX_DEPTH];
+
+/* A different seed than the board's tile keys so none of these keys
+ * collide with a tile. */
+__attribute__((constructor))
+static void tt_generate_keys(void) {
+    uint64_t state = 0x7ab1e;
+    for (int i = 0; i < BLOCK_MAX; i++)
+        hold_keys[i] = splitmix64(&state);
+    for (int i = 0; i < TT_MAX_QUEUE; i++)
+        queue_keys[i] = splitmix64(&state);
+    for (int i = 0; i < TT_MAX_DEPTH; i++)
+        depth_keys[i] = splitmix64(&state);
+}
+
+/* The table has 1 << bits entries of 16 bytes each. */
+TranspositionTable *tt_create(const int bits) {
+    assert(bits >= 1 && bits < 48);
+
+    TranspositionTable *ret = malloc(sizeof(TranspositionTable));
+    if (ret == NULL) {
+        fprintf(
+                stderr,
+                "Couldn't alloc transposition table in function %s.\n",
+                __func__);
+        exit(EXIT_FAILURE);
+    }
+    ret->mask = ((size_t)1 << bits) - 1;
+    ret->entries = calloc(ret->mask + 1, sizeof(TranspositionEntry));
+    if (ret->entries == NULL) {
+        fprintf(
+                stderr,
+                "Couldn't alloc transposition entries in function %s.\n",
+                __func__);
+        exit(EXIT_FAILURE);
+    }
+    return ret;
+}
+
+void tt_destroy(TranspositionTable *const tt) {
+    free(tt->entries);
+    free(tt);
+}
+
+/* Not safe to call while other threads use the table. */
+void tt_clear(TranspositionTable *const tt) {
+    for (size_t i = 0; i <= tt->mask; i++) {
+        atomic_init(&tt->entries[i].check, 0);
+        atomic_init(&tt->entries[i].data, 0);
+    }
+}
+
+/* Key of a search state: the board (its Zobrist hash), the held block,
+ * which block of the queue comes next and how deep the search still goes
+ * from there. */
+uint64_t tt_key(
+        const uint64_t board_hash,
+        const BlockType hold,
+        const int queue_pos,
+        const int depth) {
+    assert(hold >= BLOCK_EMPTY && hold < BLOCK_MAX);
+    assert(queue_pos >= 0 && depth >= 0);
+
+    return board_hash ^ hold_keys[hold] ^
+        queue_keys[queue_pos % TT_MAX_QUEUE] ^
+        depth_keys[depth % TT_MAX_DEPTH];
+}
+
+bool tt_probe(
+        const TranspositionTable *const tt,
+        const uint64_t key,
+        uint64_t *const data) {
+    const TranspositionEntry *entry = &tt->entries[key & tt->mask];
+    const uint64_t check =
+        atomic_load_explicit(&entry->check, memory_order_relaxed);
+    const uint64_t value =
+        atomic_load_explicit(&entry->data, memory_order_relaxed);
+    if ((check ^ value) != key)
+        return false;
+    *data = value;
+    return true;
+}
+
+void tt_store(TranspositionTable *const tt, const uint64_t key, const uint64_t data) {
+    TranspositionEntry *entry = &tt->entries[key & tt->mask];
+    atomic_store_explicit(&entry->check, key ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
@@ -0,0 +1,46 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block.h"
+
+/* Keys for the queue position and the search depth, positions and depths
+ * past these wrap around. */
+#define TT_MAX_QUEUE 64
+#define TT_MAX_DEPTH 64
+
+/* An entry stores key ^ data next to data. Both halves are written without
+ * locks so a reader racing a writer can see halves of two different
+ * stores, but then check ^ data isn't the key anymore and it's just a
+ * miss. */
+typedef struct TranspositionEntry {
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;
+} TranspositionEntry;
+
+/* Fixed size hash table shared between threads, a store always replaces
+ * whatever was in the slot. */
+typedef struct TranspositionTable {
+    size_t mask;
+    TranspositionEntry *entries;
+} TranspositionTable;
+
+TranspositionTable *tt_create(const int bits);
+void tt_destroy(TranspositionTable *const tt);
+void tt_clear(TranspositionTable *const tt);
+uint64_t tt_key(
+        const uint64_t board_hash,
+        const BlockType hold,
+        const int queue_pos,
+        const int depth);
+bool tt_probe(
+        const TranspositionTable *const tt,
+        const uint64_t key,
+        uint64_t *const data);
+void tt_store(TranspositionTable *const tt, const uint64_t key, const uint64_t data);
+
+#endif
@@ -69,206 +69,6 @@ Window *create_window_for_block_delay(const int x, const int y) {
     return window_create(17+2, 2+2, x, y);
 }
 
-int fall(Block *const block, Board *const board) {
-    int rows = 0;
-    int ret = block_move(block, board, 0, 1);
-    if (ret != 0) {
-        rows = bake(block, board);
-        block->type = BLOCK_EMPTY;
-    }
-    return rows;
-}
-
-int bake(Block *const block, Board *const board) {
-    for (int x = 0; x < BLOCK_ARR_DIM; x++) {
-        for (int y = 0; y < BLOCK_ARR_DIM; y++) {
-            if (block_get_tile(block, x, y)) {
-                *board_get_block(board, block->x+x, block->y+y) = block->type;
-            }
-        }
-    }
-    return board_clear_full_rows(board);
-}
-
-bool block_can_move(
-        const Block *const block,
-        const Board *const board,
-        const int mov_x,
-        const int mov_y) {
-    for (int tile_x = 0; tile_x < BLOCK_ARR_DIM; tile_x++) {
-        for (int tile_y = 0; tile_y < BLOCK_ARR_DIM; tile_y++) {
-            bool is_tile = block_get_tile(block, tile_x, tile_y);
-            if (is_tile) {
-                int x_pos = block->x + tile_x + mov_x;
-                if (x_pos < 0)
-                    return false;
-                if (x_pos >= board->width)
-                    return false;
-                int y_pos = block->y + tile_y + mov_y;
-                if (y_pos < 0)
-                    return false;
-                if (y_pos >= board->height)
-                    return false;
-                if (*board_get_block(board, x_pos, y_pos) != BLOCK_EMPTY)
-                    return false;
-            }
-        }
-    }
-    return true;
-}
-
-int block_move(
-        Block *const block,
-        const Board *const board,
-        const int x,
-        const int y) {
-    if (block_can_move(block, board, x, y)) {
-        block->x += x;
-        block->y += y;
-        return 0;
-    }
-    return -1;
-}
-
-int block_rotate_cw(Block *const block, const Board *const board) {
-    Rotation orig = block->rot;
-    block->rot = (block->rot+1) % ROTATION_MAX;
-    Move move = block_get_rotation_offset(block->type, block->rot);
-    block->x += move.x;
-    block->y += move.y;
-    if (block_move(block, board, 0, 0) == 0) {
-        return 0;
-    } else if (block_wallkick(block, board, false) == 0) {
-        return 0;
-    } else {
-        block->rot = orig;
-        block->x -= move.x;
-        block->y -= move.y;
-        return -1;
-    }
-}
-
-int block_rotate_ccw(Block *const block, const Board *const board) {
-    Rotation orig = block->rot;
-    if (block->rot == 0)
-        block->rot = ROTATION_MAX-1;
-    else
-        block->rot = block->rot-1;
-    Move move = block_get_rotation_offset(block->type, orig);
-    block->x -= move.x;
-    block->y -= move.y;
-    if (block_move(block, board, 0, 0) == 0) {
-        return 0;
-    } else if (block_wallkick(block, board, true) == 0) {
-        return 0;
-    } else {
-        block->rot = orig;
-        block->x += move.x;
-        block->y += move.y;
-        return -1;
-    }
-}
-
-int block_wallkick(
-        Block *const block,
-        const Board *const board,
-        const bool ccw) {
-    for (int i = 0; i < 4; i++) {
-        Move move;
-        if (ccw) {
-            move = block_get_wallkick(
-                    block->type,
-                    (block->rot+1) % ROTATION_MAX,
-                    i);
-            move.x *= -1;
-            move.y *= -1;
-        } else {
-            move = block_get_wallkick(block->type, block->rot, i);
-        }
-        if (block_move(block, board, move.x, move.y) == 0)
-            return 0;
-    }
-    return -1;
-}
-
-Block cast_block_shadow(const Block *const block, const Board *const board) {
-    Block shadow = *block;
-    while (block_move(&shadow, board, 0, 1) == 0 && block->type != BLOCK_EMPTY)
-        ;
-    return shadow;
-}
-
-bool is_block_on_ground(const Block *const block, const Board *const board) {
-    if (block->type == BLOCK_EMPTY)
-        return false;
-    return !block_can_move(block, board, 0, 1);
-}
-
-void stats_update(Stats *const stats, const int cleared_rows) {
-    stats->rows += cleared_rows;
-    switch (cleared_rows) {
-        case 0:
-            break;
-        case 1:
-            stats->score += 100 * stats->level;
-            break;
-        case 2:
-            stats->score += 300 * stats->level;
-            break;
-        case 3:
-            stats->score += 500 * stats->level;
-            break;
-        case 4:
-            stats->score += 800 * stats->level;
-            break;
-        default:
-            fprintf(stderr, "cleared rows weird number\n");
-            exit(EXIT_FAILURE);
-    }
-    if (cleared_rows)
-        stats->score += 50 * stats->combo * stats->level;
-    stats->level = get_level(stats->score);
-}
-
-int get_fall_after(const int level) {
-    if (level == 1)
-        return FALL_AFTER_LEVEL1;
-    if (level == 2)
-        return FALL_AFTER_LEVEL2;
-    if (level == 3)
-        return FALL_AFTER_LEVEL3;
-    if (level == 4)
-        return FALL_AFTER_LEVEL4;
-    if (level == 5)
-        return FALL_AFTER_LEVEL5;
-    if (level == 6)
-        return FALL_AFTER_LEVEL6;
-    if (level == 7)
-        return FALL_AFTER_LEVEL7;
-    if (level == 8)
-        return FALL_AFTER_LEVEL8;
-    if (level == 9)
-        return FALL_AFTER_LEVEL9;
-    if (level == 10)
-        return FALL_AFTER_LEVEL10;
-    if (level >= 11 && level <= 13)
-        return FALL_AFTER_LEVEL11;
-    if (level >= 14 && level <= 16)
-        return FALL_AFTER_LEVEL14;
-    if (level >= 17 && level <= 19)
-        return FALL_AFTER_LEVEL17;
-    if (level >= 20 && level <= 29)
-        return FALL_AFTER_LEVEL20;
-    if (level >= 30)
-        return FALL_AFTER_LEVEL30;
-    fprintf(stderr, "wrong level\n");
-    exit(EXIT_FAILURE);
-}
-
-int get_level(const int score) {
-    return score / 2500 + 1;
-}
-
 size_t get_logo_nolines(void) {
     size_t n = 1;
     for (size_t i = 0; i < strlen(tetris_logo); i++) {
@@ -405,7 +205,7 @@ static char *blocks_to_string(const Board *const board) {
 void string_to_blocks(char *str, Board *const board) {
     size_t len = board->height * board->width;
     for (size_t i = 0; i < len; i++) {
-        board->blocks[i] = str[i];
+        board_set_block(board, i % board->width, i / board->width, str[i]);
     }
 }
 
@@ -414,12 +214,12 @@ void send_board_ctx(const BoardCtx *const board_ctx, const int sockfd) {
     const char *fmt = get_board_fmt();
     const size_t dst_len = fmt_length(fmt);
     char *dst = calloc(1, dst_len);
-    char *buf_str = buf_to_string(board_ctx->buf);
-    char *blocks_str = blocks_to_string(board_ctx->board);
+    char *buf_str = buf_to_string(&board_ctx->buf);
+    char *blocks_str = blocks_to_string(&board_ctx->board);
 
     pack(dst, fmt,
-            board_ctx->board->width,
-            board_ctx->board->height,
+            board_ctx->board.width,
+            board_ctx->board.height,
             blocks_str,
 
             buf_str,
@@ -458,17 +258,17 @@ void recv_board_ctx(BoardCtx *board_ctx, const int sockfd) {
     const size_t src_len = fmt_length(fmt);
     char *src = calloc(1, src_len);
 
-    Board *board = board_ctx->board;
+    Board *board = &board_ctx->board;
     const size_t board_size = board->width * board->height;
-    CircularBuffer *buf = board_ctx->buf;
+    CircularBuffer *buf = &board_ctx->buf;
 
     char *blocks_str = calloc(1, board_size);
     char *buf_str = calloc(1, buf->size);
 
     recvall(sockfd, src, src_len);
     unpack(src, fmt,
-            &board_ctx->board->width,
-            &board_ctx->board->height,
+            &board_ctx->board.width,
+            &board_ctx->board.height,
             blocks_str,
 
             buf_str,
@@ -494,6 +294,8 @@ void recv_board_ctx(BoardCtx *board_ctx, const int sockfd) {
             &board_ctx->block_out,
             &board_ctx->lock_out
             );
+    // the generation isn't sent, every update counts as a change
+    board_ctx->generation++;
 
     string_to_blocks(blocks_str, board);
     string_to_buf(buf_str, buf);
@@ -1,6 +1,8 @@
 #include <assert.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "window.h"
 
@@ -29,11 +31,99 @@ Window *window_create(
 
     ret->width = width;
     ret->height = height;
+    ret->x = x;
+    ret->y = y;
+
+    ret->back = malloc(sizeof(chtype) * width * height);
+    ret->front = malloc(sizeof(chtype) * width * height);
+    if (ret->back == NULL || ret->front == NULL) {
+        fprintf(stderr, "Couldn't alloc window's cells in function %s.\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+    // a new curses window is all blanks
+    for (int i = 0; i < width * height; i++)
+        ret->front[i] = ' ';
+    window_clear(ret);
 
     return ret;
 }
 
 void window_destroy(Window *window) {
     delwin(window->win);
+    free(window->back);
+    free(window->front);
     free(window);
 }
+
+void window_clear(Window *const window) {
+    for (int i = 0; i < window->width * window->height; i++)
+        window->back[i] = ' ';
+}
+
+/* Cells outside of the window are dropped, like the parts of the falling
+ * block that are above the visible board. */
+void window_put(Window *const window, const int x, const int y, const chtype ch) {
+    if (x < 0 || x >= window->width || y < 0 || y >= window->height)
+        return;
+    window->back[x + y*window->width] = ch;
+}
+
+void window_print(
+        Window *const window,
+        const int x,
+        const int y,
+        const char *const fmt,
+        ...) {
+    char line[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    for (int i = 0; line[i] != '\0'; i++)
+        window_put(window, x + i, y, (unsigned char)line[i]);
+}
+
+/* The same border as box(win, 0, 0). */
+void window_box(Window *const window) {
+    const int right = window->width - 1;
+    const int bottom = window->height - 1;
+    for (int x = 1; x < right; x++) {
+        window_put(window, x, 0, ACS_HLINE);
+        window_put(window, x, bottom, ACS_HLINE);
+    }
+    for (int y = 1; y < bottom; y++) {
+        window_put(window, 0, y, ACS_VLINE);
+        window_put(window, right, y, ACS_VLINE);
+    }
+    window_put(window, 0, 0, ACS_ULCORNER);
+    window_put(window, right, 0, ACS_URCORNER);
+    window_put(window, 0, bottom, ACS_LLCORNER);
+    window_put(window, right, bottom, ACS_LRCORNER);
+}
+
+/* Writes the cells that changed since the last flush to the curses window
+ * and returns how many there were. Rows that are the same are skipped with
+ * a memcmp, every other row goes to curses as a single run from its first
+ * to its last changed cell. */
+int window_flush(Window *const window) {
+    int changed = 0;
+    for (int y = 0; y < window->height; y++) {
+        chtype *back = window->back + y*window->width;
+        chtype *front = window->front + y*window->width;
+        if (memcmp(back, front, sizeof(chtype) * window->width) == 0)
+            continue;
+        int first = 0;
+        while (back[first] == front[first])
+            first++;
+        int last = window->width - 1;
+        while (back[last] == front[last])
+            last--;
+        for (int x = first; x <= last; x++)
+            changed += back[x] != front[x];
+        // the cells in between that didn't change are written again as
+        // they are, that's cheaper than a call for every changed cell
+        mvwaddchnstr(window->win, y, first, back + first, last - first + 1);
+        memcpy(front + first, back + first, sizeof(chtype) * (last - first + 1));
+    }
+    return changed;
+}
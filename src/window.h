@@ -3,10 +3,19 @@
 
 #include <curses.h>
 
+/* The render functions draw into back, front is what the curses window
+ * already shows. Both are cells[x + y*width] with the attributes and color
+ * pair in the chtype. window_flush only hands curses the cells that differ
+ * so a frame where just the block moved touches a few cells. */
 typedef struct Window {
     WINDOW *win;
     int width;
     int height;
+    // position on the screen
+    int x;
+    int y;
+    chtype *back;
+    chtype *front;
 } Window;
 
 Window *window_create(
@@ -15,5 +24,15 @@ Window *window_create(
         const int x,
         const int y);
 void window_destroy(Window *window);
+void window_clear(Window *const window);
+void window_put(Window *const window, const int x, const int y, const chtype ch);
+void window_print(
+        Window *const window,
+        const int x,
+        const int y,
+        const char *const fmt,
+        ...);
+void window_box(Window *const window);
+int window_flush(Window *const window);
 
 #endif